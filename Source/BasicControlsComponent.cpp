@@ -31,26 +31,32 @@ public:
     PWMRange() : juce::NormalisableRange<double>(0, 100, denormalize, normalize, snap) {}
 };
 
-BasicControlsComponent::BasicControlsComponent(OSCID id) :
+BasicControlsComponent::BasicControlsComponent(Synth& synth, OSCID id) :
+    synth_(synth),
     enableButton("Enable"),
     volSlider("Volume"),
     pwmSlider("PWM"),
+    vibratoSlider("Vibrato"),
+    tremoloSlider("Tremolo"),
     voicePicker("Voice"),
     channelPicker("Channel"),
     transposePicker("Transpose")
 {
     id_ = id;
+    // start from the synth's settings, which may have been restored
+    const SynthParameters& parameters = synth.getParameters();
+    const MidiConfig& config = parameters.configs[id];
 
     // enable
     enableButton.addListener(this);
-    enableButton.setToggleState(id == 0 || id == 1, juce::sendNotification);
+    enableButton.setToggleState(config.enabled, juce::dontSendNotification);
     addAndMakeVisible(enableButton);
     // volume
     if (id != 2) {
         volSlider.addListener(this);
         volSlider.setSliderStyle(juce::Slider::Rotary);
         volSlider.setRange(0, 15, 1);
-        volSlider.setValue(15);
+        volSlider.setValue(std::round(parameters.volume[id] * 15.0), juce::dontSendNotification);
         volSlider.setTextBoxStyle(pwmSlider.TextBoxBelow, true, 0, 0);
         volSlider.setNumDecimalPlacesToDisplay(0);
         addAndMakeVisible(volSlider);
@@ -62,29 +68,44 @@ BasicControlsComponent::BasicControlsComponent(OSCID id) :
         pwmSlider.setNormalisableRange(PWMRange());
         pwmSlider.setTextBoxStyle(pwmSlider.TextBoxBelow, true, 0, 0);
         pwmSlider.setNumDecimalPlacesToDisplay(1);
-        pwmSlider.setValue(50);
+        pwmSlider.setValue(SquareOscilator::valueFromDutyCycle(parameters.duty[id]), juce::dontSendNotification);
         addAndMakeVisible(pwmSlider);
     }
+    // lfos, in semitones and fractions of the volume
+    if (id != 3) {
+        vibratoSlider.addListener(this);
+        vibratoSlider.setSliderStyle(juce::Slider::Rotary);
+        vibratoSlider.setRange(0, 2, 0.05);
+        vibratoSlider.setValue(parameters.vibrato[id].depth, juce::dontSendNotification);
+        vibratoSlider.setNumDecimalPlacesToDisplay(2);
+        addAndMakeVisible(vibratoSlider);
+        tremoloSlider.addListener(this);
+        tremoloSlider.setSliderStyle(juce::Slider::Rotary);
+        tremoloSlider.setRange(0, 1, 0.05);
+        tremoloSlider.setValue(parameters.tremolo[id].depth, juce::dontSendNotification);
+        tremoloSlider.setNumDecimalPlacesToDisplay(2);
+        addAndMakeVisible(tremoloSlider);
+    }
     // voice
     for (int i = 1; i <= 4; i++) {
         voicePicker.addItem(std::to_string(i), i);
     }
     voicePicker.addListener(this);
-    voicePicker.setSelectedId(id == 1 ? 2 : 1);
+    voicePicker.setSelectedId(config.voice + 1, juce::dontSendNotification);
     addAndMakeVisible(voicePicker);
     // channel
     for (int i = 1; i <= 16; i++) {
         channelPicker.addItem(std::to_string(i), i);
     }
     channelPicker.addListener(this);
-    channelPicker.setSelectedId(1);
+    channelPicker.setSelectedId(config.channel + 1, juce::dontSendNotification);
     addAndMakeVisible(channelPicker);
     // transpose
     for (int i = -48; i <= 48; i++) {
         transposePicker.addItem(std::to_string(i), i + 48 + 1);
     }
     transposePicker.addListener(this);
-    transposePicker.setSelectedId(48 + 1);
+    transposePicker.setSelectedId(config.transpose + 48 + 1, juce::dontSendNotification);
     addAndMakeVisible(transposePicker);
 }
 
@@ -116,31 +137,48 @@ void BasicControlsComponent::resized()
     voicePicker.setBounds(left, pickerPad, height, pickerHeight);
     channelPicker.setBounds(left, voicePicker.getBounds().getBottom(), height, pickerHeight);
     transposePicker.setBounds(left, channelPicker.getBounds().getBottom(), height, pickerHeight);
+    left = transposePicker.getBounds().getRight();
+    // lfos, in what's left
+    if (id_ != 3) {
+        int width = std::min(height, (bounds.getWidth() - left) / 2);
+        vibratoSlider.setBounds(left, 0, width, height);
+        vibratoSlider.setTextBoxStyle(vibratoSlider.TextBoxBelow, true, width, height/4);
+        tremoloSlider.setBounds(vibratoSlider.getBounds().getRight(), 0, width, height);
+        tremoloSlider.setTextBoxStyle(tremoloSlider.TextBoxBelow, true, width, height/4);
+    }
 }
 
 void BasicControlsComponent::buttonClicked(juce::Button* button)
 {
-    Synth::INSTANCE.setEnabled(id_, button->getToggleState());
+    synth_.setEnabled(id_, button->getToggleState());
 }
 
 void BasicControlsComponent::sliderValueChanged(juce::Slider *slider)
 {
     if (slider == &pwmSlider) {
         jassert(id_ == 0 || id_ == 1);
-        Synth::INSTANCE.setDutyCycle(id_, slider->getValue());
+        synth_.setDutyCycle(id_, slider->getValue());
     } else if (slider == &volSlider) {
         jassert(id_ != 2);
-        Synth::INSTANCE.setVolume(id_, ((float) slider->getValue()) / 15.0);
+        synth_.setVolume(id_, ((float) slider->getValue()) / 15.0);
+    } else if (slider == &vibratoSlider) {
+        LfoSettings lfo = synth_.getParameters().vibrato[id_];
+        lfo.depth = (float) slider->getValue();
+        synth_.setVibrato(id_, lfo);
+    } else if (slider == &tremoloSlider) {
+        LfoSettings lfo = synth_.getParameters().tremolo[id_];
+        lfo.depth = (float) slider->getValue();
+        synth_.setTremolo(id_, lfo);
     }
 }
 
 void BasicControlsComponent::comboBoxChanged(juce::ComboBox *comboBox)
 {
     if (comboBox == &voicePicker) {
-        Synth::INSTANCE.setMIDIVoice(id_, comboBox->getSelectedId() - 1);
+        synth_.setMIDIVoice(id_, comboBox->getSelectedId() - 1);
     } else if (comboBox == &channelPicker) {
-        Synth::INSTANCE.setMIDIChannel(id_, comboBox->getSelectedId() - 1);
+        synth_.setMIDIChannel(id_, comboBox->getSelectedId() - 1);
     } else if (comboBox == &transposePicker) {
-        Synth::INSTANCE.setTranspose(id_, comboBox->getSelectedId() - 48 - 1);
+        synth_.setTranspose(id_, comboBox->getSelectedId() - 48 - 1);
     }
 }
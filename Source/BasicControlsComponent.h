@@ -22,7 +22,7 @@ class BasicControlsComponent  : public juce::Component,
                                 public juce::ComboBox::Listener
 {
 public:
-    BasicControlsComponent(OSCID id);
+    BasicControlsComponent(Synth& synth, OSCID id);
     ~BasicControlsComponent() override;
 
     void paint(juce::Graphics&) override;
@@ -33,10 +33,14 @@ public:
     void comboBoxChanged(juce::ComboBox *comboBox) override;
 
 private:
+    Synth& synth_;
     OSCID id_;
     juce::ToggleButton enableButton;
     juce::Slider volSlider;
     juce::Slider pwmSlider;
+    // LFO depths, for the oscillators with a pitch
+    juce::Slider vibratoSlider;
+    juce::Slider tremoloSlider;
     juce::ComboBox voicePicker;
     juce::ComboBox channelPicker;
     juce::ComboBox transposePicker;
@@ -0,0 +1,352 @@
+/*
+  ==============================================================================
+
+    Benchmarks.cpp
+    Created: 17 Oct 2026 3:05:44pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "Synth.h"
+#include "Gb_Snd_Emu-0.1.4-patched/gb_apu/Gb_Apu.h"
+
+// Microbenchmarks for the emulation core, the mixer and the MIDI voice
+// allocation. Each one runs a single path in isolation and the results are
+// printed as JSON, so they can be compared between releases.
+
+static const long SAMPLE_RATE = 44100;
+// clocks per 1/60s frame, which is what the APU is normally run in
+static const gb_time_t FRAME_CLOCKS = CLOCK_SPEED / 60;
+
+class Benchmarks
+{
+public:
+    Benchmarks(double seconds) : seconds_(seconds) {}
+
+    void runAll()
+    {
+        // full period range, from the lowest note to just above the
+        // frequencies where the oscillators go silent
+        for (int frequency : { 0, 512, 1024, 1536, 1792, 1920, 1984, 2016, 2030, 2040 }) {
+            square(frequency);
+            wave(frequency);
+        }
+        for (int shift = 0; shift < 14; shift++) {
+            noise(shift);
+        }
+        synth<blip_low_quality>("low");
+        synth<blip_med_quality>("med");
+        synth<blip_good_quality>("good");
+        synth<blip_high_quality>("high");
+        synth<5>("widest");
+        stereoBuffer(false);
+        stereoBuffer(true);
+        for (int blockSize = 32; blockSize <= 4096; blockSize *= 2) {
+            apu(blockSize, SynthQuality::standard);
+        }
+        for (SynthQuality quality : { SynthQuality::low, SynthQuality::medium, SynthQuality::good, SynthQuality::high }) {
+            apu(64, quality);
+        }
+        modulator();
+        midiManager<NUM_OSC>(4);
+        midiManager<NUM_OSC>(12);
+        midiManager<NUM_OSC * MAX_CHIPS>(12);
+        midiManager<NUM_OSC * MAX_CHIPS>(48);
+    }
+
+    juce::var results() { return results_; }
+
+private:
+    double seconds_;
+    juce::Array<juce::var> results_;
+
+    void report(const juce::String& name, juce::DynamicObject* params, const juce::String& unit, double seconds, double count)
+    {
+        juce::DynamicObject::Ptr result = new juce::DynamicObject();
+        result->setProperty("name", name);
+        result->setProperty("params", juce::var(params));
+        result->setProperty("unit", unit);
+        result->setProperty("value", count > 0 ? seconds * 1e9 / count : 0.0);
+        result->setProperty("count", count);
+        results_.add(juce::var(result.get()));
+        std::cerr << name << " " << juce::JSON::toString(juce::var(params), true) << ": "
+                  << (count > 0 ? seconds * 1e9 / count : 0.0) << " " << unit << std::endl;
+    }
+
+    static double now()
+    {
+        return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks());
+    }
+
+    // Run one oscillator a frame at a time, throwing the samples away.
+    // Only the time spent in run() is counted.
+    void runOscillator(Gb_Osc& osc, Blip_Buffer& buf, double& elapsed, double& samples)
+    {
+        elapsed = 0;
+        samples = 0;
+        while (elapsed < seconds_) {
+            double start = now();
+            osc.run(0, FRAME_CLOCKS);
+            elapsed += now() - start;
+            buf.end_frame(FRAME_CLOCKS);
+            samples += buf.samples_avail();
+            buf.remove_samples(buf.samples_avail());
+        }
+    }
+
+    static void prepare(Blip_Buffer& buf)
+    {
+        buf.set_sample_rate(SAMPLE_RATE);
+        buf.clock_rate(CLOCK_SPEED);
+    }
+
+    void square(int frequency)
+    {
+        Blip_Buffer buf;
+        prepare(buf);
+        Gb_Square::Synth synth;
+        synth.volume(1.0);
+        Gb_Square osc;
+        osc.synth = &synth;
+        osc.outputs[1] = osc.outputs[2] = osc.outputs[3] = &buf;
+        osc.reset();
+        osc.write_register(1, 0x80); // 50% duty
+        osc.write_register(2, 0xF0); // full volume
+        osc.write_register(3, frequency & 0xFF);
+        osc.write_register(4, 0x80 | (frequency >> 8)); // trigger
+
+        double elapsed, samples;
+        runOscillator(osc, buf, elapsed, samples);
+        juce::DynamicObject* params = new juce::DynamicObject();
+        params->setProperty("frequency", frequency);
+        params->setProperty("period", osc.period);
+        report("Gb_Square::run", params, "ns/sample", elapsed, samples);
+    }
+
+    void wave(int frequency)
+    {
+        Blip_Buffer buf;
+        prepare(buf);
+        Gb_Wave::Synth synth(blip_med_quality);
+        synth.volume(1.0);
+        Gb_Wave osc;
+        osc.synth = &synth;
+        osc.outputs[1] = osc.outputs[2] = osc.outputs[3] = &buf;
+        osc.reset();
+        // a saw, so that every step is a transition
+        for (int i = 0; i < Gb_Wave::wave_size; i++) {
+            osc.wave[i] = (uint8_t) (i / 2);
+        }
+        osc.write_register(0, 0x80); // enable
+        osc.write_register(2, 0x20); // full volume
+        osc.write_register(3, frequency & 0xFF);
+        osc.write_register(4, 0x80 | (frequency >> 8)); // trigger
+
+        double elapsed, samples;
+        runOscillator(osc, buf, elapsed, samples);
+        juce::DynamicObject* params = new juce::DynamicObject();
+        params->setProperty("frequency", frequency);
+        params->setProperty("period", osc.period);
+        report("Gb_Wave::run", params, "ns/sample", elapsed, samples);
+    }
+
+    void noise(int shift)
+    {
+        Blip_Buffer buf;
+        prepare(buf);
+        Gb_Noise::Synth synth(blip_med_quality);
+        synth.volume(1.0);
+        Gb_Noise::init_tables();
+        Gb_Noise osc;
+        osc.synth = &synth;
+        osc.outputs[1] = osc.outputs[2] = osc.outputs[3] = &buf;
+        osc.reset();
+        osc.write_register(2, 0xF0); // full volume
+        osc.write_register(3, shift << 4); // 15-bit LFSR, divisor 8
+        osc.write_register(4, 0x80); // trigger
+
+        double elapsed, samples;
+        runOscillator(osc, buf, elapsed, samples);
+        juce::DynamicObject* params = new juce::DynamicObject();
+        params->setProperty("shift", shift);
+        params->setProperty("period", osc.period);
+        report("Gb_Noise::run", params, "ns/sample", elapsed, samples);
+    }
+
+    template <int quality>
+    void synth(const char* name)
+    {
+        Blip_Buffer buf;
+        prepare(buf);
+        Blip_Synth<quality, 15 * gb_apu_max_vol * 2> synth;
+        synth.volume(1.0);
+        synth.output(&buf);
+        // one transition every 32 clocks, about what a high note does
+        const int transitions = (int) (FRAME_CLOCKS / 32);
+        double elapsed = 0;
+        double count = 0;
+        int delta = 15 * gb_apu_max_vol;
+        while (elapsed < seconds_) {
+            double start = now();
+            for (int i = 0; i < transitions; i++) {
+                synth.offset_inline(i * 32, delta, &buf);
+                delta = -delta;
+            }
+            elapsed += now() - start;
+            count += transitions;
+            buf.end_frame(FRAME_CLOCKS);
+            buf.remove_samples(buf.samples_avail());
+        }
+        juce::DynamicObject* params = new juce::DynamicObject();
+        params->setProperty("quality", name);
+        report("Blip_Synth::offset_resampled", params, "ns/transition", elapsed, count);
+    }
+
+    void stereoBuffer(bool floatOutput)
+    {
+        Stereo_Buffer buf;
+        buf.set_sample_rate(SAMPLE_RATE);
+        buf.clock_rate(CLOCK_SPEED);
+        buf.clear();
+        Blip_Synth<blip_good_quality, 15 * gb_apu_max_vol * 2> synth;
+        synth.volume(1.0);
+        const int frameSamples = SAMPLE_RATE / 60 + 1;
+        juce::HeapBlock<blip_sample_t> samples(frameSamples * 2);
+        juce::AudioBuffer<float> floats(2, frameSamples);
+        float* const channels[2] = { floats.getWritePointer(0), floats.getWritePointer(1) };
+        double elapsed = 0;
+        double count = 0;
+        while (elapsed < seconds_) {
+            // something in every buffer, so the full stereo mix is used
+            for (int c = 0; c < 3; c++) {
+                synth.output(c == 0 ? buf.center() : c == 1 ? buf.left() : buf.right());
+                synth.offset(100 * c, 15 * gb_apu_max_vol);
+                synth.offset(FRAME_CLOCKS / 2 + 100 * c, -15 * gb_apu_max_vol);
+            }
+            buf.end_frame(FRAME_CLOCKS);
+            long avail = buf.samples_avail() / 2;
+            double start = now();
+            long n = floatOutput ? buf.read_samples(channels, avail) : buf.read_samples(samples, avail * 2) / 2;
+            elapsed += now() - start;
+            count += n;
+        }
+        juce::DynamicObject* params = new juce::DynamicObject();
+        params->setProperty("output", floatOutput ? "float" : "int16");
+        report("Stereo_Buffer::read_samples", params, "ns/sample", elapsed, count);
+    }
+
+    void apu(int blockSize, SynthQuality quality)
+    {
+        Apu apu;
+        apu.configure(SAMPLE_RATE, 2, blockSize);
+        apu.setQuality(quality);
+        SquareOscilatorOne osc1;
+        osc1.setApu(&apu);
+        apu.writeRegister(NR50, 0x7F);
+        apu.writeRegister(NR51, 0x11);
+        MidiEvent e = { 69, 127 };
+        osc1.setEvent(e);
+        juce::AudioBuffer<float> out(2, blockSize);
+        double elapsed = 0;
+        double count = 0;
+        while (elapsed < seconds_) {
+            double start = now();
+            apu.readSamples(&out, 0, blockSize);
+            elapsed += now() - start;
+            count += blockSize;
+        }
+        juce::DynamicObject* params = new juce::DynamicObject();
+        params->setProperty("blockSize", blockSize);
+        static const char* qualities[] = { "standard", "low", "medium", "good", "high" };
+        params->setProperty("quality", qualities[(int) quality]);
+        report("Apu::readSamples", params, "ns/sample", elapsed, count);
+    }
+
+    // Step every oscillator's LFOs, which the Synth does once per control
+    // tick before writing whatever changed
+    void modulator()
+    {
+        Modulator modulator;
+        modulator.configure(SAMPLE_RATE);
+        for (OSCID i = 0; i < NUM_OSC; i++) {
+            modulator.setVibrato(i, { 6.0f, 1.0f });
+            modulator.setTremolo(i, { 4.0f, 0.5f });
+        }
+        double elapsed = 0;
+        double count = 0;
+        double pitch = 0;
+        while (elapsed < seconds_) {
+            double start = now();
+            int tick;
+            while (modulator.nextTick(SAMPLE_RATE, tick)) {
+                pitch += modulator.pitch(0);
+                count++;
+            }
+            modulator.endBlock(SAMPLE_RATE);
+            elapsed += now() - start;
+        }
+        juce::ignoreUnused(pitch);
+        juce::DynamicObject* params = new juce::DynamicObject();
+        params->setProperty("controlRate", 256);
+        report("Modulator::nextTick", params, "ns/tick", elapsed, count);
+    }
+
+    // Press and release chords of chordSize notes, overlapping so that
+    // voices are stolen whenever there are fewer of them than notes
+    template <size_t Voices>
+    void midiManager(int chordSize)
+    {
+        MidiManager<16, Voices> manager;
+        double elapsed = 0;
+        double count = 0;
+        uint8_t root = 36;
+        while (elapsed < seconds_) {
+            double start = now();
+            for (int i = 0; i < 1000; i++) {
+                for (int n = 0; n < chordSize; n++) {
+                    manager.handle((uint8_t) (root + n * 2), 100);
+                }
+                for (int n = 0; n < chordSize; n++) {
+                    manager.handle((uint8_t) (root + n * 2), 0);
+                }
+                root = (uint8_t) (36 + (root + 5) % 48);
+            }
+            elapsed += now() - start;
+            count += 1000 * chordSize * 2;
+        }
+        juce::DynamicObject* params = new juce::DynamicObject();
+        params->setProperty("voices", (int) Voices);
+        params->setProperty("chordSize", chordSize);
+        report("MidiManager::handle", params, "ns/event", elapsed, count);
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    juce::ArgumentList args(argc, argv);
+    double seconds = 0.25;
+    if (args.containsOption("--seconds")) seconds = args.getValueForOption("--seconds").getDoubleValue();
+
+    Benchmarks benchmarks(seconds);
+    benchmarks.runAll();
+
+    juce::DynamicObject::Ptr report = new juce::DynamicObject();
+    report->setProperty("version", ProjectInfo::versionString);
+    report->setProperty("cpu", juce::SystemStats::getCpuModel());
+    report->setProperty("os", juce::SystemStats::getOperatingSystemName());
+    report->setProperty("results", benchmarks.results());
+    juce::String json = juce::JSON::toString(juce::var(report.get()));
+
+    if (args.containsOption("--output")) {
+        juce::File file = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--output"));
+        if (!file.replaceWithText(json)) {
+            std::cerr << "Couldn't write " << file.getFullPathName() << std::endl;
+            return 1;
+        }
+    } else {
+        std::cout << json << std::endl;
+    }
+    return 0;
+}
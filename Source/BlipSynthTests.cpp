@@ -0,0 +1,108 @@
+/*
+  ==============================================================================
+
+    BlipSynthTests.cpp
+    Created: 17 Oct 2026 8:14:37pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "Tests.h"
+#include "Gb_Snd_Emu-0.1.4-patched/gb_apu/Blip_Synth.h"
+
+// The SSE2 and NEON impulse kernels must give exactly the same buffers as
+// the portable loops. Blip_Synth is included a second time in its own
+// namespace with the vector kernels turned off, so that both versions can
+// be run side by side on the same transitions.
+#if BLIP_BUFFER_SSE2
+static const char* const KERNELS = "SSE2";
+#elif BLIP_BUFFER_NEON
+static const char* const KERNELS = "NEON";
+#else
+static const char* const KERNELS = "portable";
+#endif
+
+#undef BLIP_SYNTH_H
+#undef BLIP_BUFFER_SSE2
+#undef BLIP_BUFFER_NEON
+#ifndef BLIP_BUFFER_NO_SIMD
+#define BLIP_BUFFER_NO_SIMD
+#endif
+namespace portable {
+#include "Gb_Snd_Emu-0.1.4-patched/gb_apu/Blip_Synth.h"
+}
+
+static const long SAMPLE_RATE = 44100;
+static const long CLOCK_SPEED = 4194304;
+static const blip_time_t FRAME_CLOCKS = CLOCK_SPEED / 60;
+static const int FRAMES = 200;
+static const int TRANSITIONS = 500;
+
+// Add the same random transitions through both versions of the synth,
+// comparing the raw buffers after every frame. Returns false on the
+// first difference.
+template <int quality, int range>
+static bool compare(juce::Random& random)
+{
+    Blip_Buffer simd;
+    Blip_Buffer reference;
+    for (Blip_Buffer* buf : { &simd, &reference }) {
+        buf->set_sample_rate(SAMPLE_RATE, 100);
+        buf->clock_rate(CLOCK_SPEED);
+    }
+    // an odd volume, so that the impulses use all their bits
+    double volume = 0.5 + random.nextDouble() * 0.5;
+    Blip_Synth<quality, range> synth(volume);
+    portable::Blip_Synth<quality, range> portableSynth(volume);
+
+    const int abs = range < 0 ? -range : range;
+    size_t size = (simd.buffer_size_ + Blip_Buffer::widest_impulse_) * sizeof(Blip_Buffer::buf_t_);
+    for (int f = 0; f < FRAMES; f++) {
+        for (int i = 0; i < TRANSITIONS; i++) {
+            blip_time_t time = random.nextInt((int) FRAME_CLOCKS);
+            // mostly within the range, but larger ones must wrap around
+            // the same way
+            int delta = random.nextInt(abs * 2 + 1) - abs;
+            if (random.nextInt(8) == 0) delta = random.nextInt(1 << 24) - (1 << 23);
+            synth.offset(time, delta, &simd);
+            portableSynth.offset(time, delta, &reference);
+        }
+        if (std::memcmp(simd.buffer_, reference.buffer_, size) != 0) {
+            std::cerr << "Blip_Synth<" << quality << ", " << range << ">: "
+                      << KERNELS << " and portable buffers differ in frame " << f << std::endl;
+            return false;
+        }
+        for (Blip_Buffer* buf : { &simd, &reference }) {
+            buf->end_frame(FRAME_CLOCKS);
+            buf->remove_samples(buf->samples_avail());
+        }
+    }
+    std::cerr << "Blip_Synth<" << quality << ", " << range << ">: ok" << std::endl;
+    return true;
+}
+
+bool runBlipSynthTests(juce::Random& random)
+{
+    std::cerr << "Comparing the " << KERNELS << " kernels to the portable ones" << std::endl;
+
+    bool ok = true;
+    // every width, in the normal mode the APU uses
+    ok &= compare<1, 210>(random);
+    ok &= compare<2, 210>(random);
+    ok &= compare<3, 210>(random);
+    ok &= compare<4, 210>(random);
+    ok &= compare<5, 210>(random);
+    ok &= compare<3, 512>(random);
+    // and in fine mode, forced and from large ranges
+    ok &= compare<1, -210>(random);
+    ok &= compare<2, -210>(random);
+    ok &= compare<3, -210>(random);
+    ok &= compare<4, -210>(random);
+    ok &= compare<5, -210>(random);
+    ok &= compare<2, -64>(random);
+    ok &= compare<3, 1024>(random);
+    ok &= compare<4, 32767>(random);
+    return ok;
+}
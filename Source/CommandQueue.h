@@ -0,0 +1,61 @@
+/*
+  ==============================================================================
+
+    CommandQueue.h
+    Created: 17 Oct 2026 10:02:14am
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// A fixed-size single-producer/single-consumer FIFO of plain values.
+// Neither end ever allocates or blocks, so one thread (e.g. the message
+// thread) can push while another (e.g. the audio thread) drains it.
+// Capacity - 1 items can be queued at once.
+template <typename T, int Capacity>
+class CommandQueue
+{
+private:
+    juce::AbstractFifo fifo_;
+    T items_[Capacity];
+
+public:
+    CommandQueue() : fifo_(Capacity) {}
+
+    // Returns false if the queue was full and the item was dropped
+    bool push(const T& item)
+    {
+        const auto scope = fifo_.write(1);
+        if (scope.blockSize1 > 0) {
+            items_[scope.startIndex1] = item;
+        } else if (scope.blockSize2 > 0) {
+            items_[scope.startIndex2] = item;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // Returns false if there was nothing to read
+    bool pop(T& item)
+    {
+        const auto scope = fifo_.read(1);
+        if (scope.blockSize1 > 0) {
+            item = items_[scope.startIndex1];
+        } else if (scope.blockSize2 > 0) {
+            item = items_[scope.startIndex2];
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    bool isEmpty() const { return fifo_.getNumReady() == 0; }
+
+    // only safe to call while neither thread is using the queue
+    void clear() { fifo_.reset(); }
+};
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <stddef.h>
 #include <math.h>
+#include <mutex>
 
 /* Copyright (C) 2003-2005 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
@@ -24,6 +25,7 @@ Blip_Buffer::Blip_Buffer()
 {
 	samples_per_sec = 44100;
 	buffer_ = NULL;
+	owns_buffer = false;
 	
 	// try to cause assertion failure if buffer is used before these are set
 	clocks_per_sec = 0;
@@ -35,18 +37,28 @@ Blip_Buffer::Blip_Buffer()
 	bass_freq_ = 16;
 }
 
+// Samples past the end of the frame which synthesis may have reached (see
+// remove_samples())
+int const copy_extra = 1;
+
+// Extra room for count_clocks() to round up
+int const count_clocks_extra = 2;
+
 void Blip_Buffer::clear( bool entire_buffer )
 {
-	long count = (entire_buffer ? buffer_size_ : samples_avail());
+	// everything past the samples waiting (and the impulses which overlap
+	// them) is always kept clear
+	long count = (entire_buffer ? buffer_size_ : samples_avail() + copy_extra);
 	offset_ = 0;
 	reader_accum = 0;
 	if ( buffer_ )
 		memset( buffer_, sample_offset_ & 0xFF, (count + widest_impulse_) * sizeof (buf_t_) );
 }
 
-blargg_err_t Blip_Buffer::set_sample_rate( long new_rate, int msec )
+// Number of samples in a buffer of the specified length
+static unsigned buffer_size( long new_rate, int msec )
 {
-	unsigned new_size = (0xFFFFFFFF >> BLIP_BUFFER_ACCURACY) + 1 - widest_impulse_ - 64; // NOTE: replaced ULONG_MAX with 0xFFFFFFFF or else this will allocate 8GB of RAM on 64-bit machines
+	unsigned new_size = (0xFFFFFFFF >> BLIP_BUFFER_ACCURACY) + 1 - Blip_Buffer::widest_impulse_ - 64; // NOTE: replaced ULONG_MAX with 0xFFFFFFFF or else this will allocate 8GB of RAM on 64-bit machines
 	if ( msec != blip_default_length )
 	{
 		size_t s = (new_rate * (msec + 1) + 999) / 1000;
@@ -55,19 +67,53 @@ blargg_err_t Blip_Buffer::set_sample_rate( long new_rate, int msec )
 		else
 			require( false ); // requested buffer length exceeds limit
 	}
-	
-	if ( buffer_size_ != new_size )
+	return new_size;
+}
+
+long Blip_Buffer::memory_size( long new_rate, int msec )
+{
+	long size = buffer_size( new_rate, msec ) + widest_impulse_ + count_clocks_extra;
+	return (size + 7) & ~7;
+}
+
+blargg_err_t Blip_Buffer::set_sample_rate( long new_rate, int msec )
+{
+	unsigned new_size = buffer_size( new_rate, msec );
+	if ( buffer_size_ != new_size || !owns_buffer )
 	{
-		delete [] buffer_;
-		buffer_ = NULL; // allow for exception in allocation below
-		buffer_size_ = 0;
-		offset_ = 0;
+		free_buffer();
 		
-		int const count_clocks_extra = 2;
 		buffer_ = BLARGG_NEW buf_t_ [new_size + widest_impulse_ + count_clocks_extra];
 		BLARGG_CHECK_ALLOC( buffer_ );
+		owns_buffer = true;
 	}
 	
+	set_size( new_rate, msec, new_size );
+	
+	return blargg_success;
+}
+
+void Blip_Buffer::set_sample_rate( long new_rate, int msec, buf_t_* memory )
+{
+	require( memory );
+	if ( memory != buffer_ )
+		free_buffer();
+	buffer_ = memory;
+	set_size( new_rate, msec, buffer_size( new_rate, msec ) );
+}
+
+void Blip_Buffer::free_buffer()
+{
+	if ( owns_buffer )
+		delete [] buffer_;
+	buffer_ = NULL; // allow for exception in allocation
+	owns_buffer = false;
+	buffer_size_ = 0;
+	offset_ = 0;
+}
+
+void Blip_Buffer::set_size( long new_rate, int msec, unsigned new_size )
+{
 	buffer_size_ = new_size;
 	length_ = new_size * 1000 / new_rate - 1;
 	if ( msec )
@@ -80,8 +126,6 @@ blargg_err_t Blip_Buffer::set_sample_rate( long new_rate, int msec )
 	bass_freq( bass_freq_ ); // recalculate shift
 	
 	clear();
-	
-	return blargg_success;
 }
 
 blip_resampled_time_t Blip_Buffer::clock_rate_factor( long clock_rate ) const
@@ -94,7 +138,7 @@ blip_resampled_time_t Blip_Buffer::clock_rate_factor( long clock_rate ) const
 
 Blip_Buffer::~Blip_Buffer()
 {
-	delete [] buffer_;
+	free_buffer();
 }
 
 void Blip_Buffer::bass_freq( int freq )
@@ -125,17 +169,73 @@ blip_time_t Blip_Buffer::count_clocks( long count ) const
 	return ((count << BLIP_BUFFER_ACCURACY) - offset_ + (factor_ - 1)) / factor_;
 }
 
-void Blip_Impulse_::init( blip_pair_t_* imps, int w, int r, int fb )
+// Impulses for one set of parameters, shared by every Blip_Impulse_ using them
+struct Blip_Impulse_Table_ {
+	Blip_Impulse_Table_* next;
+	long refs;
+	int width;
+	int res;
+	int fine_bits;
+	int unit;
+	double treble;
+	long cutoff;
+	long sample_rate;
+	blip_pair_t_* impulses;
+};
+
+// Tables in use, guarded by the mutex. Only touched when a synth's volume or
+// equalization changes, never while synthesizing.
+static Blip_Impulse_Table_* impulse_tables;
+
+static std::mutex& impulse_tables_mutex()
+{
+	static std::mutex mutex;
+	return mutex;
+}
+
+static void release_impulse_table( Blip_Impulse_Table_* table )
+{
+	if ( !table )
+		return;
+	
+	std::lock_guard<std::mutex> lock( impulse_tables_mutex() );
+	if ( --table->refs )
+		return;
+	
+	Blip_Impulse_Table_** link = &impulse_tables;
+	while ( *link != table )
+		link = &(*link)->next;
+	*link = table->next;
+	delete [] table->impulses;
+	delete table;
+}
+
+Blip_Impulse_::Blip_Impulse_()
+{
+	table = NULL;
+	impulses = NULL;
+	init( 0, 0 );
+}
+
+Blip_Impulse_::~Blip_Impulse_()
+{
+	release_impulse_table( table );
+}
+
+void Blip_Impulse_::init( int w, int r, int fb )
 {
+	release_impulse_table( table );
+	table = NULL;
+	impulses = NULL;
+	impulses_ = NULL;
+	impulse = NULL;
+	
 	fine_bits = fb;
 	width = w;
-	impulses = (imp_t*) imps;
 	generate = true;
 	volume_unit_ = -1.0;
 	res = r;
 	buf = NULL;
-	
-	impulse = &impulses [width * res * 2 * (fine_bits ? 2 : 1)];
 	offset = 0;
 }
 
@@ -193,11 +293,11 @@ void Blip_Impulse_::fine_volume_unit()
 	
 	imp_t temp [max_res * 2 * Blip_Buffer::widest_impulse_];
 	scale_impulse( (offset & 0xffff) << fine_bits, temp );
-	imp_t* imp2 = impulses + res * 2 * width;
+	imp_t* imp2 = impulses_ + res * 2 * width;
 	scale_impulse( offset & 0xffff, imp2 );
 	
 	// merge impulses
-	imp_t* imp = impulses;
+	imp_t* imp = impulses_;
 	imp_t* src2 = temp;
 	for ( int n = res / 2 * 2 * width; n--; )
 	{
@@ -220,10 +320,61 @@ void Blip_Impulse_::volume_unit( double new_unit )
 	
 	offset = 0x10001 * (unsigned long) floor( volume_unit_ * 0x10000 + 0.5 );
 	
-	if ( fine_bits )
-		fine_volume_unit();
-	else
-		scale_impulse( offset & 0xffff, impulses );
+	update_table();
+}
+
+// Finds the table for the current parameters, making it if no other synth
+// has it yet
+void Blip_Impulse_::update_table()
+{
+	const int unit = offset & 0xffff;
+	Blip_Impulse_Table_* old_table = table;
+	
+	{
+		std::lock_guard<std::mutex> lock( impulse_tables_mutex() );
+		Blip_Impulse_Table_* t = impulse_tables;
+		while ( t && !(t->width == width && t->res == res && t->fine_bits == fine_bits &&
+				t->unit == unit && t->treble == eq.treble && t->cutoff == eq.cutoff &&
+				t->sample_rate == eq.sample_rate) )
+			t = t->next;
+		
+		if ( !t )
+		{
+			// scaled impulses, followed by the unscaled one they're made from
+			const long scaled_size = (long) width * res * 2 * (fine_bits ? 2 : 1);
+			const long base_size = (long) width * (res / 2 + 1);
+			blip_pair_t_* pairs = new blip_pair_t_ [(scaled_size + base_size + 1) / 2];
+			imp_t* imps = (imp_t*) pairs;
+			impulses_ = imps;
+			impulse = imps + scaled_size;
+			generate_impulse();
+			if ( fine_bits )
+				fine_volume_unit();
+			else
+				scale_impulse( unit, impulses_ );
+			impulses_ = NULL;
+			impulse = NULL;
+			
+			t = new Blip_Impulse_Table_;
+			t->refs = 0;
+			t->width = width;
+			t->res = res;
+			t->fine_bits = fine_bits;
+			t->unit = unit;
+			t->treble = eq.treble;
+			t->cutoff = eq.cutoff;
+			t->sample_rate = eq.sample_rate;
+			t->impulses = pairs;
+			t->next = impulse_tables;
+			impulse_tables = t;
+		}
+		
+		t->refs++;
+		table = t;
+		impulses = t->impulses;
+	}
+	
+	release_impulse_table( old_table );
 }
 
 static const double pi = 3.1415926535897932384626433832795029L;
@@ -237,6 +388,13 @@ void Blip_Impulse_::treble_eq( const blip_eq_t& new_eq )
 	generate = false;
 	eq = new_eq;
 	
+	// rescale
+	if ( volume_unit_ >= 0 )
+		update_table();
+}
+
+void Blip_Impulse_::generate_impulse()
+{
 	double treble = pow( 10.0, 1.0 / 20 * eq.treble ); // dB (-6dB = 0.50)
 	if ( treble < 0.000005 )
 		treble = 0.000005;
@@ -324,14 +482,6 @@ void Blip_Impulse_::treble_eq( const blip_eq_t& new_eq )
 			*imp++ = (imp_t) floor( sum * factor + (impulse_offset + 0.5) );
 		}
 	}
-	
-	// rescale
-	double unit = volume_unit_;
-	if ( unit >= 0 )
-	{
-		volume_unit_ = -1;
-		volume_unit( unit );
-	}
 }
 
 void Blip_Buffer::remove_samples( long count )
@@ -344,16 +494,13 @@ void Blip_Buffer::remove_samples( long count )
 	remove_silence( count );
 	
 	// Allows synthesis slightly past time passed to end_frame(), as long as it's
-	// not more than an output sample.
+	// not more than an output sample (copy_extra).
 	// to do: kind of hacky, could add run_until() which keeps track of extra synthesis
-	int const copy_extra = 1;
 	
 	// copy remaining samples to beginning and clear old samples
 	long remain = samples_avail() + widest_impulse_ + copy_extra;
-	if ( count >= remain )
-		memmove( buffer_, buffer_ + count, remain * sizeof (buf_t_) );
-	else
-		memcpy(  buffer_, buffer_ + count, remain * sizeof (buf_t_) );
+	// the regions overlap when fewer samples are removed than remain
+	memmove( buffer_, buffer_ + count, remain * sizeof (buf_t_) );
 	memset( buffer_ + remain, sample_offset_ & 0xFF, count * sizeof (buf_t_) );
 }
 
@@ -412,6 +559,74 @@ long Blip_Buffer::read_samples( blip_sample_t* out, long max_samples, bool stere
 	return count;
 }
 
+long Blip_Buffer::read_samples( float* out, long max_samples )
+{
+	require( buffer_ ); // sample rate must have been set
+	
+	long count = samples_avail();
+	if ( count > max_samples )
+		count = max_samples;
+	
+	if ( !count )
+		return 0; // optimization
+	
+	int sample_offset_ = this->sample_offset_;
+	int bass_shift = this->bass_shift;
+	buf_t_* buf = buffer_;
+	long accum = reader_accum;
+	
+	// the high-pass integrator is serial, so it runs first and the
+	// scaling and clamping is done over the whole block afterwards
+	for ( long n = 0; n < count; n++ )
+	{
+		out [n] = (float) (accum >> accum_fract);
+		accum -= accum >> bass_shift;
+		accum += (long (*buf++) - sample_offset_) << accum_fract;
+	}
+	blip_scale_float_( out, count );
+	
+	reader_accum = accum;
+	
+	remove_samples( count );
+	
+	return count;
+}
+
+void blip_scale_float_( float* out, long count )
+{
+	const float lo = -32768.0f;
+	const float hi = 32767.0f;
+	const float scale = 1.0f / 0x7FFF;
+	long i = 0;
+#if BLIP_BUFFER_SSE2
+	__m128 vlo = _mm_set1_ps( lo );
+	__m128 vhi = _mm_set1_ps( hi );
+	__m128 vscale = _mm_set1_ps( scale );
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		__m128 s = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( out + i ), vlo ), vhi );
+		_mm_storeu_ps( out + i, _mm_mul_ps( s, vscale ) );
+	}
+#elif BLIP_BUFFER_NEON
+	float32x4_t vlo = vdupq_n_f32( lo );
+	float32x4_t vhi = vdupq_n_f32( hi );
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		float32x4_t s = vminq_f32( vmaxq_f32( vld1q_f32( out + i ), vlo ), vhi );
+		vst1q_f32( out + i, vmulq_n_f32( s, scale ) );
+	}
+#endif
+	for ( ; i < count; i++ )
+	{
+		float s = out [i];
+		if ( s < lo )
+			s = lo;
+		if ( s > hi )
+			s = hi;
+		out [i] = s * scale;
+	}
+}
+
 void Blip_Buffer::mix_samples( const blip_sample_t* in, long count )
 {
 	buf_t_* buf = &buffer_ [(offset_ >> BLIP_BUFFER_ACCURACY) + (widest_impulse_ / 2 - 1)];
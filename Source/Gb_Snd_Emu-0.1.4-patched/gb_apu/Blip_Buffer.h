@@ -34,6 +34,16 @@ public:
 	// to 0 and returns error string (or propagates exception if compiler supports it).
 	blargg_err_t set_sample_rate( long samples_per_sec, int msec_length = blip_default_length );
 	
+	// Same as above, but keep the samples in 'memory' rather than allocating.
+	// It must hold memory_size( samples_per_sec, msec_length ) elements and
+	// stay valid until the buffer is given other memory or destroyed.
+	typedef STD::uint16_t buf_t_;
+	void set_sample_rate( long samples_per_sec, int msec_length, buf_t_* memory );
+	
+	// Number of elements of memory a buffer of the specified length uses,
+	// rounded up so that buffers placed one after another stay aligned
+	static long memory_size( long samples_per_sec, int msec_length );
+	
 	// Length of buffer, in milliseconds
 	int length() const;
 	
@@ -66,10 +76,15 @@ public:
 	// easy interleving of two channels into a stereo output buffer.
 	long read_samples( blip_sample_t* dest, long max_samples, bool stereo = false );
 	
+	// Same as above, but write floating-point samples from -1.0 to 1.0 and
+	// skip the 16-bit round trip
+	long read_samples( float* dest, long max_samples );
+	
 	// Remove 'count' samples from those waiting to be read
 	void remove_samples( long count );
 	
-	// Number of samples delay from synthesis to samples read out
+	// Number of samples delay from synthesis to samples read out, the same
+	// for every quality and sample rate
 	int output_latency() const;
 	
 // Beta features
@@ -111,13 +126,13 @@ private:
 	public:
 		enum { sample_offset_ = 0x7F7F }; // repeated byte allows memset to clear buffer
 		enum { widest_impulse_ = 24 };
-		typedef STD::uint16_t buf_t_;
 		
 		unsigned long factor_;
 		blip_resampled_time_t offset_;
 		buf_t_* buffer_;
 		unsigned buffer_size_;
 	private:
+		bool owns_buffer;
 		long reader_accum;
 		int bass_shift;
 		long samples_per_sec;
@@ -127,6 +142,9 @@ private:
 		
 		enum { accum_fract = 15 }; // less than 16 to give extra sample range
 		
+		void free_buffer();
+		void set_size( long samples_per_sec, int msec_length, unsigned size );
+		
 		friend class Blip_Reader;
 };
 
@@ -184,25 +202,46 @@ const int blip_res_bits_ = 5;
 
 typedef STD::uint32_t blip_pair_t_;
 
+// Scale 'count' raw sample levels in place to -1.0 to 1.0, clamping them the
+// same way 16-bit output is clamped
+void blip_scale_float_( float* out, long count );
+
+struct Blip_Impulse_Table_;
+
+// The impulses are shared by every synth in the process with the same width,
+// resolution, fine bits, equalization and volume unit. Tables are immutable
+// once made and freed when the last synth using them lets go.
 class Blip_Impulse_ {
 	typedef STD::uint16_t imp_t;
 	
 	blip_eq_t eq;
 	double  volume_unit_;
-	imp_t*  impulses;
-	imp_t*  impulse;
 	int     width;
 	int     fine_bits;
 	int     res;
 	bool    generate;
+	Blip_Impulse_Table_* table;
+	
+	// only used while making a table
+	imp_t*  impulses_;
+	imp_t*  impulse;
 	
 	void fine_volume_unit();
 	void scale_impulse( int unit, imp_t* ) const;
+	void generate_impulse();
+	void update_table();
+	
+	// noncopyable
+	Blip_Impulse_( const Blip_Impulse_& );
+	Blip_Impulse_& operator = ( const Blip_Impulse_& );
 public:
 	Blip_Buffer*  buf;
 	STD::uint32_t offset;
+	const blip_pair_t_* impulses; // NULL until the volume is set
 	
-	void init( blip_pair_t_* impulses, int width, int res, int fine_bits = 0 );
+	Blip_Impulse_();
+	~Blip_Impulse_();
+	void init( int width, int res, int fine_bits = 0 );
 	void volume_unit( double );
 	void treble_eq( const blip_eq_t& );
 };
@@ -240,7 +279,10 @@ inline void Blip_Buffer::remove_silence( long count ) {
 }
 
 inline int Blip_Buffer::output_latency() const {
-	return widest_impulse_ / 2;
+	// Every impulse is centred two samples short of widest_impulse_ / 2,
+	// and reading adds half a sample, so a step is half way up a sample
+	// and a half before that. Rounded up to a whole sample.
+	return widest_impulse_ / 2 - 1;
 }
 
 inline long Blip_Buffer::clock_rate() const {
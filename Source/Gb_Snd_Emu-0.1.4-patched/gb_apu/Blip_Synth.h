@@ -37,14 +37,12 @@ class Blip_Synth {
 		width = (quality < 5 ? quality * 4 : Blip_Buffer::widest_impulse_),
 		res = 1 << blip_res_bits_,
 		impulse_size = width / 2 * (fine_mode + 1),
-		base_impulses_size = width / 2 * (res / 2 + 1),
 		fine_bits = (fine_mode ? (abs_range <= 64 ? 2 : abs_range <= 128 ? 3 :
 			abs_range <= 256 ? 4 : abs_range <= 512 ? 5 : abs_range <= 1024 ? 6 :
 			abs_range <= 2048 ? 7 : 8) : 0)
 	};
-	blip_pair_t_  impulses [impulse_size * res * 2 + base_impulses_size];
 	Blip_Impulse_ impulse;
-	void init() { impulse.init( impulses, width, res, fine_bits ); }
+	void init() { impulse.init( width, res, fine_bits ); }
 public:
 	Blip_Synth()                            { init(); }
 	Blip_Synth( double volume )             { init(); this->volume( volume ); }
@@ -128,7 +126,107 @@ public:
 };
 
 // End of public interface
-	
+
+// Vectorized impulse kernels. SSE2 or NEON is used when the compiler targets
+// it; define BLIP_BUFFER_NO_SIMD to force the portable loops (which produce
+// identical results, all arithmetic being modulo 2^32; Test/ checks this).
+#if !defined (BLIP_BUFFER_NO_SIMD)
+	#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+		#include <emmintrin.h>
+		#if defined (__SSE4_1__) || defined (__AVX__)
+			#include <smmintrin.h>
+		#endif
+		#define BLIP_BUFFER_SSE2 1
+	#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+		#include <arm_neon.h>
+		#define BLIP_BUFFER_NEON 1
+	#endif
+#endif
+
+#if BLIP_BUFFER_SSE2
+	// low 32 bits of a * b in each lane
+	inline __m128i blip_mul32_( __m128i a, __m128i b )
+	{
+	#if defined (__SSE4_1__) || defined (__AVX__)
+		return _mm_mullo_epi32( a, b );
+	#else
+		__m128i even = _mm_mul_epu32( a, b );
+		__m128i odd  = _mm_mul_epu32( _mm_srli_si128( a, 4 ), _mm_srli_si128( b, 4 ) );
+		return _mm_unpacklo_epi32( _mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 ) ),
+				_mm_shuffle_epi32( odd, _MM_SHUFFLE( 0, 0, 2, 0 ) ) );
+	#endif
+	}
+#endif
+
+// buf [i] += imp [i] * delta - offset, for count pairs
+inline void blip_offset_pairs_( blip_pair_t_* buf, const blip_pair_t_* imp, int count,
+		blip_pair_t_ offset, int delta )
+{
+	int i = 0;
+#if BLIP_BUFFER_SSE2
+	__m128i vd = _mm_set1_epi32( delta );
+	__m128i vo = _mm_set1_epi32( (int) offset );
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		__m128i b = _mm_loadu_si128( (const __m128i*) (buf + i) );
+		__m128i p = _mm_loadu_si128( (const __m128i*) (imp + i) );
+		b = _mm_add_epi32( _mm_sub_epi32( b, vo ), blip_mul32_( p, vd ) );
+		_mm_storeu_si128( (__m128i*) (buf + i), b );
+	}
+#elif BLIP_BUFFER_NEON
+	uint32x4_t vo = vdupq_n_u32( offset );
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		uint32x4_t b = vsubq_u32( vld1q_u32( buf + i ), vo );
+		b = vmlaq_n_u32( b, vld1q_u32( imp + i ), (blip_pair_t_) delta );
+		vst1q_u32( buf + i, b );
+	}
+#endif
+	for ( ; i < count; i++ )
+		buf [i] = buf [i] - offset + imp [i] * delta;
+}
+
+// buf [i] += imp [i * 2] * delta2 + imp [i * 2 + 1] * delta - offset, for count pairs
+inline void blip_offset_pairs_fine_( blip_pair_t_* buf, const blip_pair_t_* imp, int count,
+		blip_pair_t_ offset, int delta, int delta2 )
+{
+	int i = 0;
+#if BLIP_BUFFER_SSE2
+	__m128i vd = _mm_set1_epi32( delta );
+	__m128i vd2 = _mm_set1_epi32( delta2 );
+	__m128i vo = _mm_set1_epi32( (int) offset );
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		// split the interleaved impulse into its delta2 and delta halves
+		__m128 lo = _mm_castsi128_ps( _mm_loadu_si128( (const __m128i*) (imp + i * 2) ) );
+		__m128 hi = _mm_castsi128_ps( _mm_loadu_si128( (const __m128i*) (imp + i * 2 + 4) ) );
+		__m128i p2 = _mm_castps_si128( _mm_shuffle_ps( lo, hi, _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+		__m128i p  = _mm_castps_si128( _mm_shuffle_ps( lo, hi, _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+		__m128i b = _mm_loadu_si128( (const __m128i*) (buf + i) );
+		b = _mm_add_epi32( _mm_sub_epi32( b, vo ), blip_mul32_( p2, vd2 ) );
+		b = _mm_add_epi32( b, blip_mul32_( p, vd ) );
+		_mm_storeu_si128( (__m128i*) (buf + i), b );
+	}
+#elif BLIP_BUFFER_NEON
+	uint32x4_t vo = vdupq_n_u32( offset );
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		uint32x4x2_t p = vld2q_u32( imp + i * 2 );
+		uint32x4_t b = vsubq_u32( vld1q_u32( buf + i ), vo );
+		b = vmlaq_n_u32( b, p.val [0], (blip_pair_t_) delta2 );
+		b = vmlaq_n_u32( b, p.val [1], (blip_pair_t_) delta );
+		vst1q_u32( buf + i, b );
+	}
+#endif
+	for ( ; i < count; i++ )
+	{
+		blip_pair_t_ t = buf [i] - offset;
+		t += imp [i * 2] * delta2;
+		t += imp [i * 2 + 1] * delta;
+		buf [i] = t;
+	}
+}
+
 template<int quality,int range>
 void Blip_Wave<quality,range>::amplitude( int amp ) {
 	int delta = amp - last_amp;
@@ -150,26 +248,15 @@ inline void Blip_Synth<quality,range>::offset_resampled( blip_resampled_time_t t
 	
 	enum { shift = BLIP_BUFFER_ACCURACY - blip_res_bits_ };
 	enum { mask = res * 2 - 1 };
-	const pair_t* imp = &impulses [((time >> shift) & mask) * impulse_size];
+	const pair_t* imp = &impulse.impulses [((time >> shift) & mask) * impulse_size];
 	
 	pair_t offset = impulse.offset * delta;
 	
+	// an impulse is width / 2 pairs, i.e. one or two vectors
 	if ( !fine_bits )
 	{
 		// normal mode
-		for ( int n = width / 4; n; --n )
-		{
-			pair_t t0 = buf [0] - offset;
-			pair_t t1 = buf [1] - offset;
-			
-			t0 += imp [0] * delta;
-			t1 += imp [1] * delta;
-			imp += 2;
-			
-			buf [0] = t0;
-			buf [1] = t1;
-			buf += 2;
-		}
+		blip_offset_pairs_( buf, imp, width / 2, offset, delta );
 	}
 	else
 	{
@@ -179,23 +266,7 @@ inline void Blip_Synth<quality,range>::offset_resampled( blip_resampled_time_t t
 		int delta2 = (delta & (sub_range - 1)) - sub_range / 2;
 		delta >>= fine_bits;
 		
-		for ( int n = width / 4; n; --n )
-		{
-			pair_t t0 = buf [0] - offset;
-			pair_t t1 = buf [1] - offset;
-			
-			t0 += imp [0] * delta2;
-			t0 += imp [1] * delta;
-			
-			t1 += imp [2] * delta2;
-			t1 += imp [3] * delta;
-			
-			imp += 4;
-			
-			buf [0] = t0;
-			buf [1] = t1;
-			buf += 2;
-		}
+		blip_offset_pairs_fine_( buf, imp, width / 2, offset, delta, delta2 );
 	}
 }
 
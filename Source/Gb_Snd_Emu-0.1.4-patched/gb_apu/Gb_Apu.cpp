@@ -18,7 +18,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA */
 
 #include BLARGG_SOURCE_BEGIN
 
-Gb_Apu::Gb_Apu()
+Gb_Apu::Gb_Apu() :
+	square_synth( blip_good_quality ),
+	other_synth( blip_med_quality )
 {
 	square1.synth = &square_synth;
 	square2.synth = &square_synth;
@@ -31,6 +33,9 @@ Gb_Apu::Gb_Apu()
 	oscs [2] = &wave;
 	oscs [3] = &noise;
 	
+	// not on the audio thread
+	Gb_Noise::init_tables();
+	
 	volume( 1.0 );
 	reset();
 }
@@ -45,6 +50,14 @@ void Gb_Apu::treble_eq( const blip_eq_t& eq )
 	other_synth.treble_eq( eq );
 }
 
+void Gb_Apu::quality( int square, int other )
+{
+	require( blip_low_quality <= square && square <= blip_high_quality );
+	require( blip_low_quality <= other && other <= blip_high_quality );
+	square_synth.quality = square;
+	other_synth.quality = other;
+}
+
 void Gb_Apu::volume( double vol )
 {
 	vol *= 0.60 / osc_count;
@@ -101,6 +114,12 @@ void Gb_Apu::run_until( gb_time_t end_time )
 	if ( end_time == last_time )
 		return;
 	
+	if ( idle() )
+	{
+		skip_until( end_time );
+		return;
+	}
+	
 	while ( true )
 	{
 		gb_time_t time = next_frame_time;
@@ -142,6 +161,62 @@ void Gb_Apu::run_until( gb_time_t end_time )
 	}
 }
 
+// True if none of the oscillators will make a sound until a register is
+// written, i.e. running them would only move the frame sequencer's counters
+bool Gb_Apu::idle() const
+{
+	for ( int i = 0; i < osc_count; ++i ) {
+		const Gb_Osc& osc = *oscs [i];
+		if ( osc.output && osc.last_amp )
+			return false;
+	}
+	return (!square1.output || square1.silent()) && square1.envelope_idle() && square1.sweep_idle() &&
+			(!square2.output || square2.silent()) && square2.envelope_idle() &&
+			(!wave.output || wave.silent()) &&
+			(!noise.output || noise.silent()) && noise.envelope_idle();
+}
+
+// Same result as run_until() while idle(), but with the frame sequencer's
+// steps counted up front rather than run one at a time
+void Gb_Apu::skip_until( gb_time_t end_time )
+{
+	enum { frame_period = 4194304 / 256 };
+	
+	// the loop in run_until() steps at every frame time before end_time
+	long steps = 0;
+	if ( next_frame_time < end_time )
+		steps = (end_time - next_frame_time - 1) / frame_period + 1;
+	
+	for ( int i = 0; i < osc_count; ++i ) {
+		Gb_Osc& osc = *oscs [i];
+		if ( osc.output ) {
+			if ( osc.output != osc.outputs [3] )
+				stereo_found = true;
+			osc.delay = 0;
+		}
+	}
+	last_time = end_time;
+	
+	if ( !steps )
+		return;
+	next_frame_time += steps * frame_period;
+	
+	// 256 Hz actions
+	square1.skip_length( steps );
+	square2.skip_length( steps );
+	wave.skip_length( steps );
+	noise.skip_length( steps );
+	
+	// 64 Hz actions, whenever frame_count wraps around to 0
+	long envelope_steps = (frame_count + steps) / 4;
+	frame_count = (frame_count + steps) & 3;
+	square1.skip_envelope( envelope_steps );
+	square2.skip_envelope( envelope_steps );
+	noise.skip_envelope( envelope_steps );
+	
+	// sweep is idle, so there's nothing to do for the 128 Hz clock
+}
+
 bool Gb_Apu::end_frame( gb_time_t end_time )
 {
 	if ( end_time > last_time )
@@ -233,6 +308,7 @@ void Gb_Apu::write_register( gb_time_t time, gb_addr_t addr, int data )
 		int index = (addr & 0x0f) * 2;
 		wave.wave [index] = data >> 4;
 		wave.wave [index + 1] = data & 0x0f;
+		wave.runs_valid = false;
 	}
 }
 
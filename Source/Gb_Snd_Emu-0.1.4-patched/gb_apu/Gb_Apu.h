@@ -22,6 +22,13 @@ public:
 	// Set treble equalization
 	void treble_eq( const blip_eq_t& );
 	
+	// Set band-limiting quality of all oscillators, from blip_low_quality (least
+	// CPU) to blip_high_quality (least aliasing), or of the squares and of the
+	// wave and noise separately. Can be changed at any time. Squares use
+	// blip_good_quality and the others blip_med_quality by default.
+	void quality( int );
+	void quality( int square, int other );
+	
 	// Reset oscillators and internal state
 	void reset();
 	
@@ -74,9 +81,13 @@ private:
 	Gb_Wave::Synth   other_synth;  // shared between wave and noise
 	
 	void run_until( gb_time_t );
+	bool idle() const;
+	void skip_until( gb_time_t );
 };
 
 inline void Gb_Apu::output( Blip_Buffer* b ) { output( b, NULL, NULL ); }
+
+inline void Gb_Apu::quality( int q ) { quality( q, q ); }
 	
 inline void Gb_Apu::osc_output( int i, Blip_Buffer* b ) { osc_output( i, b, NULL, NULL ); }
 
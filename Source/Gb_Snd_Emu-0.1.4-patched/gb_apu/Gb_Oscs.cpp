@@ -20,6 +20,56 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA */
 
 const int trigger = 0x80;
 
+// Gb_Synth
+
+Gb_Synth::Gb_Synth( int q )
+{
+	require( blip_low_quality <= q && q <= blip_high_quality );
+	quality = q;
+}
+
+void Gb_Synth::volume( double v )
+{
+	// every level is kept up to date so that changing quality is free
+	low.volume( v );
+	med.volume( v );
+	good.volume( v );
+	high.volume( v );
+}
+
+void Gb_Synth::treble_eq( const blip_eq_t& eq )
+{
+	low.treble_eq( eq );
+	med.treble_eq( eq );
+	good.treble_eq( eq );
+	high.treble_eq( eq );
+}
+
+void Gb_Synth::offset( blip_time_t time, int delta, Blip_Buffer* buf ) const
+{
+	switch ( quality )
+	{
+	case blip_low_quality:  low.offset( time, delta, buf ); break;
+	case blip_med_quality:  med.offset( time, delta, buf ); break;
+	case blip_good_quality: good.offset( time, delta, buf ); break;
+	default:                high.offset( time, delta, buf ); break;
+	}
+}
+
+// Call osc.run_() with its synth at the current quality
+template<class Osc>
+inline void run_with_quality( Osc& osc, gb_time_t time, gb_time_t end_time )
+{
+	const Gb_Synth& synth = *osc.synth;
+	switch ( synth.quality )
+	{
+	case blip_low_quality:  osc.run_( synth.low, time, end_time ); break;
+	case blip_med_quality:  osc.run_( synth.med, time, end_time ); break;
+	case blip_good_quality: osc.run_( synth.good, time, end_time ); break;
+	default:                osc.run_( synth.high, time, end_time ); break;
+	}
+}
+
 // Gb_Osc
 
 Gb_Osc::Gb_Osc()
@@ -52,6 +102,12 @@ void Gb_Osc::clock_length()
 		--length;
 }
 
+void Gb_Osc::skip_length( int count )
+{
+	if ( length_enabled )
+		length = (length > count) ? length - count : 0;
+}
+
 void Gb_Osc::write_register( int reg, int value )
 {
 	if ( reg == 4 )
@@ -90,6 +146,20 @@ void Gb_Env::clock_envelope()
 	}
 }
 
+void Gb_Env::skip_envelope( int count )
+{
+	// the volume is pinned, so only the delay counter moves. It counts down
+	// to zero, then restarts from env_period (and stays at 0 if that's 0).
+	if ( !env_delay )
+		return;
+	if ( count < env_delay ) {
+		env_delay -= count;
+		return;
+	}
+	count -= env_delay;
+	env_delay = env_period ? env_period - count % env_period : 0;
+}
+
 void Gb_Env::write_register( int reg, int value )
 {
 	if ( reg == 2 ) {
@@ -197,16 +267,21 @@ void Gb_Square::write_register( int reg, int value )
 }
 
 void Gb_Square::run( gb_time_t time, gb_time_t end_time )
+{
+	run_with_quality( *this, time, end_time );
+}
+
+template<class Blip_Synth_>
+void Gb_Square::run_( const Blip_Synth_& synth, gb_time_t time, gb_time_t end_time )
 {
 	// to do: when frequency goes above 20000 Hz output should actually be 1/2 volume
 	// rather than 0
 	
-	if ( !enabled || (!length && length_enabled) || !volume || sweep_freq == 2048 ||
-			!frequency || period < 27 )
+	if ( silent() )
 	{
 		if ( last_amp )
 		{
-			synth->offset( time, -last_amp, output );
+			synth.offset( time, -last_amp, output );
 			last_amp = 0;
 		}
 		delay = 0;
@@ -217,7 +292,7 @@ void Gb_Square::run( gb_time_t time, gb_time_t end_time )
 		amp *= global_volume;
 		if ( amp != last_amp )
 		{
-			synth->offset( time, amp - last_amp, output );
+			synth.offset( time, amp - last_amp, output );
 			last_amp = amp;
 		}
 		
@@ -228,17 +303,28 @@ void Gb_Square::run( gb_time_t time, gb_time_t end_time )
 			const int duty = this->duty;
 			int phase = this->phase;
 			amp *= 2;
-			do
+			
+			// phase advances once per period and the level changes when it
+			// reaches 0 or duty, so step straight from one edge to the next
+			long count = (end_time - time + period - 1) / period;
+			const gb_time_t last_time = time + count * period;
+			while ( true )
 			{
-				phase = (phase + 1) & 7;
-				if ( phase == 0 || phase == duty )
-				{
-					amp = -amp;
-					synth->offset_inline( time, amp, output );
-				}
+				int to_edge = 8 - phase;
+				int to_duty = (duty - phase) & 7;
+				if ( to_duty && to_duty < to_edge )
+					to_edge = to_duty;
+				if ( to_edge > count )
+					break;
+				count -= to_edge;
+				phase = (phase + to_edge) & 7;
+				time += (to_edge - 1) * period;
+				amp = -amp;
+				synth.offset_inline( time, amp, output );
 				time += period;
 			}
-			while ( time < end_time );
+			phase = (phase + count) & 7;
+			time = last_time;
 			
 			this->phase = phase;
 			last_amp = amp >> 1;
@@ -256,9 +342,26 @@ void Gb_Wave::reset()
 	wave_pos = 0;
 	new_length = 0;
 	memset( wave, 0, sizeof wave );
+	runs_valid = false;
 	Gb_Osc::reset();
 }
 
+void Gb_Wave::update_runs()
+{
+	int steps = 0;
+	for ( int i = wave_size * 2; i--; )
+	{
+		int pos = i % wave_size;
+		int next = (pos + 1) % wave_size;
+		if ( (wave [pos] >> volume_shift) != (wave [next] >> volume_shift) )
+			steps = 1;
+		else if ( steps )
+			steps++;
+		runs [pos] = steps;
+	}
+	runs_valid = true;
+}
+
 Gb_Wave::Gb_Wave() {
 }
 
@@ -278,6 +381,7 @@ void Gb_Wave::write_register( int reg, int value )
 	case 2:
 		volume = ((value >> 5) & 3);
 		volume_shift = (volume - 1) & 7; // silence = 7
+		runs_valid = false;
 		break;
 	
 	case 3:
@@ -301,13 +405,19 @@ void Gb_Wave::write_register( int reg, int value )
 }
 
 void Gb_Wave::run( gb_time_t time, gb_time_t end_time )
+{
+	run_with_quality( *this, time, end_time );
+}
+
+template<class Blip_Synth_>
+void Gb_Wave::run_( const Blip_Synth_& synth, gb_time_t time, gb_time_t end_time )
 {
 	// to do: when frequency goes above 20000 Hz output should actually be 1/2 volume
 	// rather than 0
-	if ( !enabled || (!length && length_enabled) || !volume || !frequency || period < 7 )
+	if ( silent() )
 	{
 		if ( last_amp ) {
-			synth->offset( time, -last_amp, output );
+			synth.offset( time, -last_amp, output );
 			last_amp = 0;
 		}
 		delay = 0;
@@ -321,7 +431,7 @@ void Gb_Wave::run( gb_time_t time, gb_time_t end_time )
 		if ( diff )
 		{
 			last_amp += diff;
-			synth->offset( time, diff, output );
+			synth.offset( time, diff, output );
 		}
 		
 		time += delay;
@@ -330,19 +440,28 @@ void Gb_Wave::run( gb_time_t time, gb_time_t end_time )
 			int const volume_shift = this->volume_shift;
 		 	int wave_pos = this->wave_pos;
 		 	
-			do
+			if ( !runs_valid )
+				update_runs();
+			
+			// only visit the steps where the level changes
+			long count = (end_time - time + period - 1) / period;
+			const gb_time_t last_time = time + count * period;
+			while ( true )
 			{
-				wave_pos = unsigned (wave_pos + 1) % wave_size;
+				int run = runs [wave_pos];
+				if ( !run || run > count )
+					break;
+				count -= run;
+				wave_pos = unsigned (wave_pos + run) % wave_size;
+				time += (run - 1) * period;
 				int amp = (wave [wave_pos] >> volume_shift) * vol_factor;
 				int delta = amp - last_amp;
-				if ( delta )
-				{
-					last_amp = amp;
-					synth->offset_inline( time, delta, output );
-				}
+				last_amp = amp;
+				synth.offset_inline( time, delta, output );
 				time += period;
 			}
-			while ( time < end_time );
+			wave_pos = unsigned (wave_pos + count) % wave_size;
+			time = last_time;
 			
 			this->wave_pos = wave_pos;
 		}
@@ -353,6 +472,71 @@ void Gb_Wave::run( gb_time_t time, gb_time_t end_time )
 
 // Gb_Noise
 
+// Every state of the 15-bit or 7-bit LFSR in the order they occur, so
+// run() can jump from one level change to the next instead of clocking the
+// LFSR one step at a time
+struct Gb_Noise_Table {
+	unsigned size;                            // length of the sequence
+	const unsigned short* state;              // state at each position
+	const unsigned short* pos;                // position of each state (0 unused)
+	const unsigned char* run;                 // steps until the output next changes
+	
+	static const Gb_Noise_Table& get( int width );
+};
+
+// the storage for a table, sized for its width
+template<int width>
+class Gb_Noise_Sequence : public Gb_Noise_Table {
+	enum { length = (1 << width) - 1 };
+	unsigned short states [length];
+	unsigned short positions [length + 1];
+	unsigned char runs [length];
+public:
+	Gb_Noise_Sequence();
+};
+
+template<int width>
+Gb_Noise_Sequence<width>::Gb_Noise_Sequence()
+{
+	size = length;
+	state = states;
+	pos = positions;
+	run = runs;
+	
+	const int tap = width - 1;
+	unsigned bits = 1;
+	for ( unsigned i = 0; i < size; i++ ) {
+		states [i] = bits;
+		positions [bits] = i;
+		unsigned feedback = 1 & (bits ^ (bits >> 1));
+		bits = (feedback << tap) | (bits >> 1);
+	}
+	positions [0] = 0;
+	assert( bits == 1 ); // maximal length sequence
+	
+	// the output changes on the step out of a state whose lowest two bits
+	// differ. Go around twice so the runs wrap past the end.
+	int steps = 0;
+	for ( int i = size * 2; i--; ) {
+		unsigned s = states [i % size];
+		steps = ((s ^ (s >> 1)) & 1) ? 1 : steps + 1;
+		runs [i % size] = steps;
+	}
+}
+
+const Gb_Noise_Table& Gb_Noise_Table::get( int width )
+{
+	static const Gb_Noise_Sequence<15> long_table;
+	static const Gb_Noise_Sequence<7> short_table;
+	return (width == 15) ? (const Gb_Noise_Table&) long_table : short_table;
+}
+
+void Gb_Noise::init_tables()
+{
+	Gb_Noise_Table::get( 15 );
+	Gb_Noise_Table::get( 7 );
+}
+
 void Gb_Noise::reset()
 {
 	bits = 1;
@@ -398,9 +582,15 @@ void Gb_Noise::write_register( int reg, int value )
 
 void Gb_Noise::run( gb_time_t time, gb_time_t end_time )
 {
-	if ( !enabled || (!length && length_enabled) || !volume ) {
+	run_with_quality( *this, time, end_time );
+}
+
+template<class Blip_Synth_>
+void Gb_Noise::run_( const Blip_Synth_& synth, gb_time_t time, gb_time_t end_time )
+{
+	if ( silent() ) {
 		if ( last_amp ) {
-			synth->offset( time, -last_amp, output );
+			synth.offset( time, -last_amp, output );
 			last_amp = 0;
 		}
 		delay = 0;
@@ -410,7 +600,7 @@ void Gb_Noise::run( gb_time_t time, gb_time_t end_time )
 		int amp = bits & 1 ? -volume : volume;
 		amp *= global_volume;
 		if ( amp != last_amp ) {
-			synth->offset( time, amp - last_amp, output );
+			synth.offset( time, amp - last_amp, output );
 			last_amp = amp;
 		}
 		
@@ -418,32 +608,50 @@ void Gb_Noise::run( gb_time_t time, gb_time_t end_time )
 		if ( time < end_time )
 		{
 			Blip_Buffer* const output = this->output;
-			// keep parallel resampled time to eliminate multiplication in the loop
 			const blip_resampled_time_t resampled_period =
 					output->resampled_duration( period );
 			blip_resampled_time_t resampled_time = output->resampled_time( time );
-			const unsigned mask = ~(1u << tap);
-			unsigned bits = this->bits;
-			amp *= 2;
 			
-			do {
-				unsigned feedback = bits;
-				bits >>= 1;
-				feedback = 1 & (feedback ^ bits);
-				time += period;
-				bits = (feedback << tap) | (bits & mask);
-				// feedback just happens to be true only when the level needs to change
-				// (the previous and current bits are different)
-				if ( feedback ) {
+			// number of times the LFSR is clocked before end_time
+			long count = (end_time - time + period - 1) / period;
+			time += count * period;
+			
+			// Bits above the tap only shift down towards it and are replaced by
+			// feedback once they get there, so they never affect the output.
+			const int width = tap + 1;
+			unsigned low = bits & ((1u << width) - 1);
+			unsigned high = bits >> width;
+			high = (count < 32) ? high >> count : 0;
+			
+			// all zero is the one state not in the sequence, and never changes
+			if ( low )
+			{
+				const Gb_Noise_Table& table = Gb_Noise_Table::get( width );
+				unsigned pos = table.pos [low];
+				amp *= 2;
+				
+				// jump from one level change to the next
+				while ( count >= table.run [pos] )
+				{
+					int run = table.run [pos];
+					count -= run;
+					resampled_time += (run - 1) * resampled_period;
 					amp = -amp;
-					synth->offset_resampled( resampled_time, amp, output );
+					synth.offset_resampled( resampled_time, amp, output );
+					resampled_time += resampled_period;
+					pos += run;
+					if ( pos >= table.size )
+						pos -= table.size;
 				}
-				resampled_time += resampled_period;
+				
+				pos += count;
+				if ( pos >= table.size )
+					pos -= table.size;
+				low = table.state [pos];
+				last_amp = amp >> 1;
 			}
-			while ( time < end_time );
 			
-			this->bits = bits;
-			last_amp = amp >> 1;
+			this->bits = (high << width) | low;
 		}
 		delay = time - end_time;
 	}
@@ -10,6 +10,26 @@
 
 enum { gb_apu_max_vol = 7 };
 
+// The oscillators' transition synthesizer at every quality level, so that the
+// quality can be changed at any time. Each oscillator's run() picks one once
+// per call and its loop is compiled for each, rather than choosing per
+// transition.
+struct Gb_Synth {
+	enum { range = 15 * gb_apu_max_vol * 2 };
+	Blip_Synth<blip_low_quality,range>  low;
+	Blip_Synth<blip_med_quality,range>  med;
+	Blip_Synth<blip_good_quality,range> good;
+	Blip_Synth<blip_high_quality,range> high;
+	int quality;
+	
+	Gb_Synth( int quality = blip_good_quality );
+	void volume( double );
+	void treble_eq( const blip_eq_t& );
+	
+	// Add a transition at the current quality, for the few made outside run()
+	void offset( blip_time_t, int delta, Blip_Buffer* ) const;
+};
+
 struct Gb_Osc {
 	Blip_Buffer* outputs [4]; // NULL, right, left, center
 	Blip_Buffer* output;
@@ -29,6 +49,7 @@ struct Gb_Osc {
 	Gb_Osc();
 	
 	void clock_length();
+	void skip_length( int count ); // same as calling clock_length() count times
 	void reset();
 	virtual void run( gb_time_t begin, gb_time_t end ) = 0;
 	virtual void write_register( int reg, int value );
@@ -44,6 +65,10 @@ struct Gb_Env : Gb_Osc {
 	void reset();
 	void clock_envelope();
 	void write_register( int, int );
+	
+	// true if clocking the envelope can't change the volume
+	bool envelope_idle() const;
+	void skip_envelope( int count ); // only valid while envelope_idle()
 };
 
 struct Gb_Square : Gb_Env {
@@ -57,14 +82,19 @@ struct Gb_Square : Gb_Env {
 	int sweep_freq;
 	bool has_sweep;
 	
-	typedef Blip_Synth<blip_good_quality,15 * gb_apu_max_vol * 2> Synth;
+	typedef Gb_Synth Synth;
 	const Synth* synth;
 	
 	Gb_Square();
 	void reset();
 	void run( gb_time_t, gb_time_t );
+	template<class Blip_Synth_>
+	void run_( const Blip_Synth_&, gb_time_t, gb_time_t );
 	void write_register( int, int );
 	void clock_sweep();
+	
+	bool silent() const;
+	bool sweep_idle() const { return !(sweep_period && sweep_delay); }
 };
 
 struct Gb_Wave : Gb_Osc {
@@ -74,27 +104,66 @@ struct Gb_Wave : Gb_Osc {
 	bool new_enabled;
 	STD::uint8_t wave [wave_size];
 	
-	typedef Blip_Synth<blip_med_quality,15 * gb_apu_max_vol * 2> Synth;
+	// Number of steps from each position to the next one with a different
+	// level at the current volume_shift (0 if the level never changes).
+	// Must be invalidated whenever wave or volume_shift change.
+	STD::uint8_t runs [wave_size];
+	bool runs_valid;
+	void update_runs();
+	
+	typedef Gb_Synth Synth;
 	const Synth* synth;
 	
 	Gb_Wave();
 	void reset();
 	void run( gb_time_t, gb_time_t );
+	template<class Blip_Synth_>
+	void run_( const Blip_Synth_&, gb_time_t, gb_time_t );
 	void write_register( int, int );
+	
+	bool silent() const;
 };
 
 struct Gb_Noise : Gb_Env {
 	unsigned bits;
 	int tap;
 	
-	typedef Blip_Synth<blip_med_quality,15 * gb_apu_max_vol * 2> Synth;
+	typedef Gb_Synth Synth;
 	const Synth* synth;
 	
 	Gb_Noise();
 	void reset();
 	void run( gb_time_t, gb_time_t );
+	template<class Blip_Synth_>
+	void run_( const Blip_Synth_&, gb_time_t, gb_time_t );
 	void write_register( int, int );
+	
+	// Build the LFSR tables run() jumps through, which is otherwise done
+	// by the first run(). Gb_Apu does this when it's constructed.
+	static void init_tables();
+	
+	bool silent() const;
 };
 
+// run() only removes any remaining amplitude and generates nothing else
+// while an oscillator is silent
+
+inline bool Gb_Square::silent() const {
+	return !enabled || (!length && length_enabled) || !volume || sweep_freq == 2048 ||
+			!frequency || period < 27;
+}
+
+inline bool Gb_Wave::silent() const {
+	return !enabled || (!length && length_enabled) || !volume || !frequency || period < 7;
+}
+
+inline bool Gb_Noise::silent() const {
+	return !enabled || (!length && length_enabled) || !volume;
+}
+
+inline bool Gb_Env::envelope_idle() const {
+	return !env_delay || (env_dir ? volume >= 15 : volume <= 0);
+}
+
 #endif
 
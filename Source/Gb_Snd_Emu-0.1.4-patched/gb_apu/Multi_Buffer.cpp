@@ -3,6 +3,8 @@
 
 #include "Multi_Buffer.h"
 
+#include <string.h>
+
 /* Copyright (C) 2003-2005 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -87,6 +89,14 @@ blargg_err_t Stereo_Buffer::set_sample_rate( long rate, int msec )
 	return Multi_Buffer::set_sample_rate( bufs [0].sample_rate(), bufs [0].length() );
 }
 
+void Stereo_Buffer::set_sample_rate( long rate, int msec, Blip_Buffer::buf_t_* memory )
+{
+	long size = Blip_Buffer::memory_size( rate, msec );
+	for ( int i = 0; i < buf_count; i++ )
+		bufs [i].set_sample_rate( rate, msec, memory + i * size );
+	Multi_Buffer::set_sample_rate( bufs [0].sample_rate(), bufs [0].length() );
+}
+
 void Stereo_Buffer::clock_rate( long rate )
 {
 	for ( int i = 0; i < buf_count; i++ )
@@ -99,12 +109,12 @@ void Stereo_Buffer::bass_freq( int bass )
 		bufs [i].bass_freq( bass );
 }
 
-void Stereo_Buffer::clear()
+void Stereo_Buffer::clear( bool entire_buffer )
 {
 	stereo_added = false;
 	was_stereo = false;
 	for ( int i = 0; i < buf_count; i++ )
-		bufs [i].clear();
+		bufs [i].clear( entire_buffer );
 }
 
 void Stereo_Buffer::end_frame( blip_time_t clock_count, bool stereo )
@@ -126,33 +136,55 @@ long Stereo_Buffer::read_samples( blip_sample_t* out, long count )
 	if ( count )
 	{
 		if ( stereo_added || was_stereo )
-		{
 			mix_stereo( out, count );
-			
-			bufs [0].remove_samples( count );
-			bufs [1].remove_samples( count );
-			bufs [2].remove_samples( count );
-		}
 		else
-		{
 			mix_mono( out, count );
-			
-			bufs [0].remove_samples( count );
-			
-			bufs [1].remove_silence( count );
-			bufs [2].remove_silence( count );
-		}
-		
-		// to do: this might miss opportunities for optimization
-		if ( !bufs [0].samples_avail() ) {
-			was_stereo = stereo_added;
-			stereo_added = false;
-		}
+		remove_samples( count );
 	}
 	
 	return count * 2;
 }
 
+long Stereo_Buffer::read_samples( float* const* out, long count )
+{
+	long avail = bufs [0].samples_avail();
+	if ( count > avail )
+		count = avail;
+	if ( count )
+	{
+		if ( stereo_added || was_stereo )
+			mix_stereo( out [0], out [1], count );
+		else
+			mix_mono( out [0], out [1], count );
+		remove_samples( count );
+	}
+	
+	return count;
+}
+
+void Stereo_Buffer::remove_samples( long count )
+{
+	if ( stereo_added || was_stereo )
+	{
+		bufs [0].remove_samples( count );
+		bufs [1].remove_samples( count );
+		bufs [2].remove_samples( count );
+	}
+	else
+	{
+		bufs [0].remove_samples( count );
+		
+		bufs [1].remove_silence( count );
+		bufs [2].remove_silence( count );
+	}
+	
+	// to do: this might miss opportunities for optimization
+	if ( !bufs [0].samples_avail() ) {
+		was_stereo = stereo_added;
+		stereo_added = false;
+	}
+}
+
 #include BLARGG_ENABLE_OPTIMIZER
 
 void Stereo_Buffer::mix_stereo( blip_sample_t* out, long count )
@@ -213,3 +245,59 @@ void Stereo_Buffer::mix_mono( blip_sample_t* out, long count )
 	in.end( bufs [0] );
 }
 
+// The float versions run each Blip_Reader's integrator over the whole block
+// in turn, since each one depends on the previous sample, then scale and clamp
+// the summed channels with blip_scale_float_().
+
+void Stereo_Buffer::mix_stereo( float* left_out, float* right_out, long count )
+{
+	Blip_Reader left; 
+	Blip_Reader right; 
+	Blip_Reader center;
+	
+	int bass = center.begin( bufs [0] );
+	for ( long i = 0; i < count; i++ )
+	{
+		float c = (float) center.read();
+		center.next( bass );
+		left_out [i] = c;
+		right_out [i] = c;
+	}
+	center.end( bufs [0] );
+	
+	left.begin( bufs [1] );
+	for ( long i = 0; i < count; i++ )
+	{
+		left_out [i] += (float) left.read();
+		left.next( bass );
+	}
+	left.end( bufs [1] );
+	
+	right.begin( bufs [2] );
+	for ( long i = 0; i < count; i++ )
+	{
+		right_out [i] += (float) right.read();
+		right.next( bass );
+	}
+	right.end( bufs [2] );
+	
+	blip_scale_float_( left_out, count );
+	blip_scale_float_( right_out, count );
+}
+
+void Stereo_Buffer::mix_mono( float* left_out, float* right_out, long count )
+{
+	Blip_Reader in;
+	int bass = in.begin( bufs [0] );
+	
+	for ( long i = 0; i < count; i++ )
+	{
+		left_out [i] = (float) in.read();
+		in.next( bass );
+	}
+	
+	in.end( bufs [0] );
+	
+	blip_scale_float_( left_out, count );
+	memcpy( right_out, left_out, count * sizeof *right_out );
+}
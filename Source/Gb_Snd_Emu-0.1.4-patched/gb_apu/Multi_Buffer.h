@@ -30,7 +30,7 @@ public:
 	virtual blargg_err_t set_sample_rate( long rate, int msec = blip_default_length ) = 0;
 	virtual void clock_rate( long ) = 0;
 	virtual void bass_freq( int ) = 0;
-	virtual void clear() = 0;
+	virtual void clear( bool entire_buffer = true ) = 0;
 	long sample_rate() const;
 	
 	// Length of buffer, in milliseconds
@@ -52,6 +52,11 @@ public:
 	virtual long read_samples( blip_sample_t*, long ) = 0;
 	virtual long samples_avail() const = 0;
 	
+	// Read at most 'count' sample frames as floating-point samples from -1.0
+	// to 1.0, one pointer per channel (samples_per_frame() of them). Returns
+	// the number of sample frames read.
+	virtual long read_samples( float* const* out, long count ) = 0;
+	
 protected:
 	void channels_changed() { channels_changed_count_++; }
 private:
@@ -79,11 +84,16 @@ public:
 	blargg_err_t set_sample_rate( long rate, int msec = blip_default_length );
 	void clock_rate( long );
 	void bass_freq( int );
-	void clear();
+	void clear( bool entire_buffer = true );
 	channel_t channel( int );
+	
+	// See Blip_Buffer
+	void set_sample_rate( long rate, int msec, Blip_Buffer::buf_t_* memory );
+	static long memory_size( long rate, int msec );
 	void end_frame( blip_time_t, bool unused = true );
 	long samples_avail() const;
 	long read_samples( blip_sample_t*, long );
+	long read_samples( float* const*, long );
 };
 
 // Uses three buffers (one for center) and outputs stereo sample pairs.
@@ -101,12 +111,17 @@ public:
 	blargg_err_t set_sample_rate( long, int msec = blip_default_length );
 	void clock_rate( long );
 	void bass_freq( int );
-	void clear();
+	void clear( bool entire_buffer = true );
 	channel_t channel( int index );
 	void end_frame( blip_time_t, bool added_stereo = true );
 	
+	// See Blip_Buffer. The three buffers are placed one after another.
+	void set_sample_rate( long rate, int msec, Blip_Buffer::buf_t_* memory );
+	static long memory_size( long rate, int msec );
+	
 	long samples_avail() const;
 	long read_samples( blip_sample_t*, long );
+	long read_samples( float* const*, long );
 	
 private:
 	enum { buf_count = 3 };
@@ -117,6 +132,9 @@ private:
 	
 	void mix_stereo( blip_sample_t*, long );
 	void mix_mono( blip_sample_t*, long );
+	void mix_stereo( float* left, float* right, long );
+	void mix_mono( float* left, float* right, long );
+	void remove_samples( long );
 };
 
 // Silent_Buffer generates no samples, useful where no sound is wanted
@@ -128,11 +146,12 @@ public:
 	blargg_err_t set_sample_rate( long rate, int msec = blip_default_length );
 	void clock_rate( long ) { }
 	void bass_freq( int ) { }
-	void clear() { }
+	void clear( bool = true ) { }
 	channel_t channel( int ) { return chan; }
 	void end_frame( blip_time_t, bool unused = true ) { }
 	long samples_avail() const { return 0; }
 	long read_samples( blip_sample_t*, long ) { return 0; }
+	long read_samples( float* const*, long ) { return 0; }
 };
 
 
@@ -162,12 +181,24 @@ inline int Multi_Buffer::length() const { return length_; }
 
 inline void Mono_Buffer::clock_rate( long rate ) { buf.clock_rate( rate ); }
 
-inline void Mono_Buffer::clear() { buf.clear(); }
+inline void Mono_Buffer::clear( bool entire_buffer ) { buf.clear( entire_buffer ); }
+
+inline void Mono_Buffer::set_sample_rate( long rate, int msec, Blip_Buffer::buf_t_* memory )
+{
+	buf.set_sample_rate( rate, msec, memory );
+	Multi_Buffer::set_sample_rate( buf.sample_rate(), buf.length() );
+}
+
+inline long Mono_Buffer::memory_size( long rate, int msec ) { return Blip_Buffer::memory_size( rate, msec ); }
+
+inline long Stereo_Buffer::memory_size( long rate, int msec ) { return Blip_Buffer::memory_size( rate, msec ) * buf_count; }
 
 inline void Mono_Buffer::bass_freq( int freq ) { buf.bass_freq( freq ); }
 
 inline long Mono_Buffer::read_samples( blip_sample_t* p, long s ) { return buf.read_samples( p, s ); }
 
+inline long Mono_Buffer::read_samples( float* const* out, long s ) { return buf.read_samples( out [0], s ); }
+
 inline long Mono_Buffer::samples_avail() const { return buf.samples_avail(); }
 
 #endif
@@ -13,7 +13,7 @@
 #include "Theme.h"
 
 //==============================================================================
-NoiseOscComponent::NoiseOscComponent() : controls(3)
+NoiseOscComponent::NoiseOscComponent(Synth& synth) : controls(synth, 3)
 {
     addAndMakeVisible(controls);
 }
@@ -19,7 +19,7 @@
 class NoiseOscComponent  : public juce::Component
 {
 public:
-    NoiseOscComponent();
+    NoiseOscComponent(Synth& synth);
     ~NoiseOscComponent() override;
 
     void paint(juce::Graphics&) override;
@@ -0,0 +1,132 @@
+/*
+  ==============================================================================
+
+    OfflineRenderer.cpp
+    Created: 17 Oct 2026 2:12:08pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#include "OfflineRenderer.h"
+
+OfflineRenderer::OfflineRenderer(const RenderSettings& settings) : settings_(settings) {}
+
+bool OfflineRenderer::readSequence(const juce::File& midiFile, juce::MidiMessageSequence& sequence)
+{
+    juce::FileInputStream in(midiFile);
+    juce::MidiFile midi;
+    if (!in.openedOk() || !midi.readFrom(in)) return false;
+    midi.convertTimestampTicksToSeconds();
+    // the synth doesn't care which track an event came from
+    for (int t = 0; t < midi.getNumTracks(); t++) {
+        sequence.addSequence(*midi.getTrack(t), 0.0);
+    }
+    sequence.updateMatchedPairs();
+    return true;
+}
+
+juce::String OfflineRenderer::render(const juce::File& midiFile, const juce::File& wavFile)
+{
+    // VGM files are played back as they are rather than through the synth
+    bool playVgm = midiFile.hasFileExtension("vgm");
+    juce::MidiMessageSequence sequence;
+    double length;
+    if (playVgm) {
+        player_ = std::make_unique<VgmPlayer>();
+        player_->configure(settings_.sampleRate, settings_.channels, settings_.blockSize);
+        player_->setQuality(settings_.quality);
+        juce::String error = player_->load(midiFile);
+        if (error.isNotEmpty()) return error;
+        length = player_->getLengthSeconds() + settings_.tailSeconds;
+    } else {
+        if (!readSequence(midiFile, sequence)) {
+            return "Couldn't read MIDI file " + midiFile.getFullPathName();
+        }
+        length = sequence.getEndTime() + settings_.tailSeconds;
+
+        // same defaults as the editor: both squares on, one voice each
+        synth_ = std::make_unique<Synth>();
+        synth_->configure(settings_.sampleRate, settings_.channels, settings_.blockSize);
+        synth_->setEnabled(0, true);
+        synth_->setMIDIVoice(0, 0);
+        synth_->setEnabled(1, true);
+        synth_->setMIDIVoice(1, 1);
+        if (settings_.chips > 1) synth_->setChipCount(settings_.chips);
+        synth_->setQuality(settings_.quality);
+        juce::File vgmFile = wavFile.withFileExtension("vgm");
+        if (settings_.vgm && !synth_->startRecording(vgmFile)) {
+            return "Couldn't write VGM file " + vgmFile.getFullPathName();
+        }
+    }
+
+    // the writer takes ownership of the stream once it's been created
+    wavFile.deleteFile();
+    auto stream = std::make_unique<juce::FileOutputStream>(wavFile);
+    if (stream->failedToOpen()) {
+        return "Couldn't write WAV file " + wavFile.getFullPathName();
+    }
+    juce::FileOutputStream* output = stream.get();
+    std::unique_ptr<juce::AudioFormatWriter> wave(juce::WavAudioFormat().createWriterFor(
+        output, settings_.sampleRate, (unsigned int) settings_.channels, 16, {}, 0));
+    if (wave == nullptr) {
+        return "Couldn't write WAV file " + wavFile.getFullPathName();
+    }
+    stream.release();
+
+    juce::AudioBuffer<float> buffer(settings_.channels, settings_.blockSize);
+    juce::MidiBuffer midi;
+
+    int64_t totalSamples = (int64_t) (length * settings_.sampleRate);
+    bool written = true;
+    int next = 0;
+    for (int64_t start = 0; start < totalSamples; start += settings_.blockSize) {
+        int count = (int) std::min((int64_t) settings_.blockSize, totalSamples - start);
+        // collect the events which fall in this block
+        midi.clear();
+        double blockEnd = (double) (start + count) / settings_.sampleRate;
+        for (; next < sequence.getNumEvents(); next++) {
+            const juce::MidiMessage& msg = sequence.getEventPointer(next)->message;
+            if (msg.getTimeStamp() >= blockEnd) break;
+            int offset = (int) (msg.getTimeStamp() * settings_.sampleRate - (double) start);
+            midi.addEvent(msg, juce::jlimit(0, count - 1, offset));
+        }
+
+        buffer.setSize(settings_.channels, count, false, false, true);
+        buffer.clear();
+        if (playVgm) {
+            player_->render(&buffer, start, true);
+        } else {
+            synth_->processCommands();
+            synth_->handleMIDI(midi);
+            synth_->readSamples(&buffer);
+        }
+
+        if (!wave->writeFromAudioSampleBuffer(buffer, 0, count)) {
+            written = false;
+            break;
+        }
+    }
+    if (synth_ != nullptr) {
+        synth_->stopRecording();
+        synth_->stop();
+    }
+    // rewrite the header with the final length
+    if (!written || !wave->flush() || output->getStatus().failed()) {
+        return "Couldn't write WAV file " + wavFile.getFullPathName();
+    }
+    return {};
+}
+
+OfflineRenderJob::OfflineRenderJob(const RenderSettings& settings, const juce::File& midi, const juce::File& wav) :
+    juce::ThreadPoolJob("Render " + midi.getFileName()),
+    midiFile(midi),
+    wavFile(wav),
+    settings_(settings) {}
+
+juce::ThreadPoolJob::JobStatus OfflineRenderJob::runJob()
+{
+    OfflineRenderer renderer(settings_);
+    error = renderer.render(midiFile, wavFile);
+    return jobHasFinished;
+}
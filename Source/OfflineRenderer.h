@@ -0,0 +1,66 @@
+/*
+  ==============================================================================
+
+    OfflineRenderer.h
+    Created: 17 Oct 2026 2:12:08pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Synth.h"
+#include "VgmPlayer.h"
+
+struct RenderSettings
+{
+    double sampleRate = 44100.0;
+    int channels = 2;
+    int blockSize = 512;
+    int chips = 1;
+    // how long to keep rendering after the last MIDI event
+    double tailSeconds = 1.0;
+    // also record the register writes of MIDI files to a VGM file next
+    // to the WAV
+    bool vgm = false;
+    // there's no deadline, so alias as little as possible
+    SynthQuality quality = SynthQuality::high;
+};
+
+// Renders a Standard MIDI File to a WAV file as fast as possible, using
+// the same Synth the plugin does with the editor's default patch.
+// A VGM file is played back by a VgmPlayer instead.
+// Each renderer owns its own Synth, so several can run at once on
+// different threads.
+class OfflineRenderer
+{
+public:
+    OfflineRenderer(const RenderSettings& settings);
+
+    // Returns an error message, or an empty string on success
+    juce::String render(const juce::File& midiFile, const juce::File& wavFile);
+
+private:
+    RenderSettings settings_;
+    std::unique_ptr<Synth> synth_;
+    std::unique_ptr<VgmPlayer> player_;
+
+    bool readSequence(const juce::File& midiFile, juce::MidiMessageSequence& sequence);
+};
+
+// Renders a batch of files, one job per file on a pool of threads
+class OfflineRenderJob : public juce::ThreadPoolJob
+{
+public:
+    OfflineRenderJob(const RenderSettings& settings, const juce::File& midiFile, const juce::File& wavFile);
+    JobStatus runJob() override;
+
+    juce::File midiFile;
+    juce::File wavFile;
+    juce::String error;
+
+private:
+    RenderSettings settings_;
+};
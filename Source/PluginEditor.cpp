@@ -14,8 +14,15 @@
 GameBoySynthAudioProcessorEditor::GameBoySynthAudioProcessorEditor(GameBoySynthAudioProcessor& p)
     : AudioProcessorEditor (&p),
         audioProcessor (p),
-        osc0(0),
-        osc1(1),
+        osc0(p.getSynth(), 0),
+        osc1(p.getSynth(), 1),
+        osc2(p.getSynth()),
+        osc3(p.getSynth()),
+        chipPicker("Chips"),
+        policyPicker("Voice Policy"),
+        qualityPicker("Quality"),
+        vgmButton("VGM"),
+        recordButton("Rec"),
         keyboard(keyboardState, juce::MidiKeyboardComponent::horizontalKeyboard)
 {
     theme(getLookAndFeel());
@@ -25,6 +32,38 @@ GameBoySynthAudioProcessorEditor::GameBoySynthAudioProcessorEditor(GameBoySynthA
     addAndMakeVisible(osc1);
     addAndMakeVisible(osc2);
     addAndMakeVisible(osc3);
+    // chips
+    for (int i = 1; i <= MAX_CHIPS; i++) {
+        chipPicker.addItem(std::to_string(i) + "x", i);
+    }
+    chipPicker.addListener(this);
+    chipPicker.setSelectedId(p.getSynth().getParameters().chips, juce::dontSendNotification);
+    addAndMakeVisible(chipPicker);
+    // voice allocation, in VoicePolicy order
+    policyPicker.addItem("LRU", 1);
+    policyPicker.addItem("Low", 2);
+    policyPicker.addItem("High", 3);
+    policyPicker.addItem("Cycle", 4);
+    policyPicker.addItem("Hold", 5);
+    policyPicker.addListener(this);
+    policyPicker.setSelectedId((int) p.getSynth().getParameters().policy + 1, juce::dontSendNotification);
+    addAndMakeVisible(policyPicker);
+    // band-limiting, in SynthQuality order
+    qualityPicker.addItem("Standard", 1);
+    qualityPicker.addItem("Low", 2);
+    qualityPicker.addItem("Medium", 3);
+    qualityPicker.addItem("Good", 4);
+    qualityPicker.addItem("High", 5);
+    qualityPicker.addListener(this);
+    qualityPicker.setSelectedId((int) p.getSynth().getParameters().quality + 1, juce::dontSendNotification);
+    addAndMakeVisible(qualityPicker);
+    // vgm
+    vgmButton.addListener(this);
+    updateVgmButton();
+    addAndMakeVisible(vgmButton);
+    recordButton.addListener(this);
+    updateRecordButton();
+    addAndMakeVisible(recordButton);
     // keyboard
     keyboardState.addListener(audioProcessor.getMidiCollector());
     addAndMakeVisible(keyboard);
@@ -44,5 +83,88 @@ void GameBoySynthAudioProcessorEditor::resized()
     osc1.setBounds(OscBoxWidth, 0, OscBoxWidth, OscBoxHeight);
     osc2.setBounds(0, OscBoxHeight, OscBoxWidth, OscBoxHeight);
     osc3.setBounds(OscBoxWidth, OscBoxHeight, OscBoxWidth, OscBoxHeight);
-    keyboard.setBounds(0, WindowHeight-KeyboardHeight, WindowWidth, KeyboardHeight);
+    int rowHeight = KeyboardHeight / 4;
+    chipPicker.setBounds(0, WindowHeight-KeyboardHeight, ChipPickerWidth, rowHeight);
+    policyPicker.setBounds(0, chipPicker.getBottom(), ChipPickerWidth, rowHeight);
+    qualityPicker.setBounds(0, policyPicker.getBottom(), ChipPickerWidth, rowHeight);
+    vgmButton.setBounds(0, qualityPicker.getBottom(), ChipPickerWidth / 2, WindowHeight-qualityPicker.getBottom());
+    recordButton.setBounds(vgmButton.getRight(), qualityPicker.getBottom(), ChipPickerWidth - vgmButton.getWidth(), vgmButton.getHeight());
+    keyboard.setBounds(ChipPickerWidth, WindowHeight-KeyboardHeight, WindowWidth-ChipPickerWidth, KeyboardHeight);
+}
+
+void GameBoySynthAudioProcessorEditor::comboBoxChanged(juce::ComboBox* comboBox)
+{
+    if (comboBox == &chipPicker) {
+        audioProcessor.getSynth().setChipCount(chipPicker.getSelectedId());
+    } else if (comboBox == &policyPicker) {
+        audioProcessor.getSynth().setVoicePolicy((VoicePolicy) (policyPicker.getSelectedId() - 1));
+    } else if (comboBox == &qualityPicker) {
+        audioProcessor.getSynth().setQuality((SynthQuality) (qualityPicker.getSelectedId() - 1));
+    }
+}
+
+void GameBoySynthAudioProcessorEditor::buttonClicked(juce::Button* button)
+{
+    if (button == &vgmButton) {
+        loadVgm();
+    } else if (button == &recordButton) {
+        toggleRecording();
+    }
+}
+
+void GameBoySynthAudioProcessorEditor::loadVgm()
+{
+    VgmPlayer& player = audioProcessor.getPlayer();
+    if (player.isLoaded()) {
+        player.unload();
+        updateVgmButton();
+        return;
+    }
+    vgmChooser = std::make_unique<juce::FileChooser>("Play a VGM file with the host", juce::File(), "*.vgm");
+    int flags = juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles;
+    vgmChooser->launchAsync(flags, [this](const juce::FileChooser& chooser) {
+        juce::File file = chooser.getResult();
+        if (file == juce::File()) return;
+        juce::String error = audioProcessor.getPlayer().load(file);
+        if (error.isNotEmpty()) {
+            juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Couldn't play VGM file", error);
+        }
+        updateVgmButton();
+    });
+}
+
+void GameBoySynthAudioProcessorEditor::updateVgmButton()
+{
+    VgmPlayer& player = audioProcessor.getPlayer();
+    vgmButton.setButtonText(player.isLoaded() ? player.getFile().getFileNameWithoutExtension() : "VGM");
+}
+
+void GameBoySynthAudioProcessorEditor::toggleRecording()
+{
+    Synth& synth = audioProcessor.getSynth();
+    if (synth.isRecording()) {
+        synth.stopRecording();
+        updateRecordButton();
+        return;
+    }
+    vgmChooser = std::make_unique<juce::FileChooser>("Record the register writes to a VGM file", juce::File(), "*.vgm");
+    int flags = juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles
+        | juce::FileBrowserComponent::warnAboutOverwriting;
+    vgmChooser->launchAsync(flags, [this](const juce::FileChooser& chooser) {
+        juce::File file = chooser.getResult();
+        if (file == juce::File()) return;
+        if (!audioProcessor.getSynth().startRecording(file.withFileExtension("vgm"))) {
+            juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Couldn't record VGM file",
+                "Couldn't write " + file.getFullPathName());
+        }
+        updateRecordButton();
+    });
+}
+
+void GameBoySynthAudioProcessorEditor::updateRecordButton()
+{
+    // recording carries on while the editor is closed
+    bool recording = audioProcessor.getSynth().isRecording();
+    recordButton.setButtonText(recording ? "Stop" : "Rec");
+    recordButton.setToggleState(recording, juce::dontSendNotification);
 }
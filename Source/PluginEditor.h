@@ -18,7 +18,9 @@
 //==============================================================================
 /**
 */
-class GameBoySynthAudioProcessorEditor  : public juce::AudioProcessorEditor
+class GameBoySynthAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                          public juce::ComboBox::Listener,
+                                          public juce::Button::Listener
 {
 public:
     GameBoySynthAudioProcessorEditor(GameBoySynthAudioProcessor&);
@@ -28,6 +30,9 @@ public:
     void paint(juce::Graphics&) override;
     void resized() override;
 
+    void comboBoxChanged(juce::ComboBox* comboBox) override;
+    void buttonClicked(juce::Button* button) override;
+
 private:
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
@@ -36,8 +41,24 @@ private:
     SquareOscComponent osc1;
     WaveOscComponent osc2;
     NoiseOscComponent osc3;
+    // number of emulated chips, i.e. polyphony in multiples of 4 voices
+    juce::ComboBox chipPicker;
+    // how keys are assigned to voices when there aren't enough
+    juce::ComboBox policyPicker;
+    // less CPU or less aliasing
+    juce::ComboBox qualityPicker;
+    // loads a VGM file to play along with the host, or unloads it
+    juce::TextButton vgmButton;
+    std::unique_ptr<juce::FileChooser> vgmChooser;
+    // records what the synth plays to a VGM file, or stops recording
+    juce::TextButton recordButton;
     juce::MidiKeyboardState keyboardState;
     juce::MidiKeyboardComponent keyboard;
 
+    void updateVgmButton();
+    void updateRecordButton();
+    void loadVgm();
+    void toggleRecording();
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GameBoySynthAudioProcessorEditor)
 };
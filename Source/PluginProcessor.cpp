@@ -8,9 +8,6 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
-#include "Synth.h"
-
-Synth Synth::INSTANCE;
 
 //==============================================================================
 GameBoySynthAudioProcessor::GameBoySynthAudioProcessor()
@@ -94,15 +91,18 @@ void GameBoySynthAudioProcessor::changeProgramName(int index, const juce::String
 //==============================================================================
 void GameBoySynthAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-    Synth::INSTANCE.configure(sampleRate, getTotalNumOutputChannels());
+    synth_.configure(sampleRate, getTotalNumOutputChannels(), samplesPerBlock);
+    player_.configure(sampleRate, getTotalNumOutputChannels(), samplesPerBlock);
     midiCollector_.reset(sampleRate);
+    // the VGM player's APU lags by the same amount
+    setLatencySamples(synth_.getLatencySamples());
 }
 
 void GameBoySynthAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
-    Synth::INSTANCE.stop();
+    synth_.stop();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -136,10 +136,24 @@ void GameBoySynthAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
     juce::ScopedNoDenormals noDenormals;
     if (!buffer.hasBeenCleared()) buffer.clear();
 
+    // apply parameter changes from the UI before anything else touches the APU
+    synth_.processCommands();
+
+    juce::AudioPlayHead::CurrentPositionInfo position;
+    juce::AudioPlayHead* playHead = getPlayHead();
+    bool hasPosition = playHead != nullptr && playHead->getCurrentPosition(position);
+    // the LFOs can step in time with the host
+    if (hasPosition) synth_.setTempo(position.bpm);
+
     // also append any events from the collector
     midiCollector_.removeNextBlockOfMessages(midiMessages, (int) buffer.getNumSamples());
-    Synth::INSTANCE.handleMIDI(midiMessages);
-    Synth::INSTANCE.readSamples(&buffer);
+    synth_.handleMIDI(midiMessages);
+    synth_.readSamples(&buffer);
+
+    // the VGM player, if a file is loaded, follows the host's position
+    if (hasPosition) {
+        player_.render(&buffer, position.timeInSamples, position.isPlaying);
+    }
 }
 
 //==============================================================================
@@ -156,15 +170,18 @@ juce::AudioProcessorEditor* GameBoySynthAudioProcessor::createEditor()
 //==============================================================================
 void GameBoySynthAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    // a small binary blob rather than XML, so that projects with many
+    // instances load quickly
+    synth_.saveState(destData);
 }
 
 void GameBoySynthAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    // the registers are written directly by the audio thread; an open
+    // editor isn't updated. Projects saved by versions without a state
+    // have an empty one, and keep the current settings like anything
+    // else loadState doesn't recognise.
+    synth_.loadState(data, sizeInBytes);
 }
 
 //==============================================================================
@@ -9,6 +9,8 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "Synth.h"
+#include "VgmPlayer.h"
 
 //==============================================================================
 /**
@@ -55,10 +57,17 @@ public:
 
     //==============================================================================
     juce::MidiMessageCollector* getMidiCollector() { return &midiCollector_; }
+    // Each instance of the plugin has its own emulator. The editor uses this
+    // to send parameter changes to it.
+    Synth& getSynth() { return synth_; }
+    // plays a VGM file along with the host's transport
+    VgmPlayer& getPlayer() { return player_; }
 
 private:
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GameBoySynthAudioProcessor)
 
     juce::MidiMessageCollector midiCollector_;
+    Synth synth_;
+    VgmPlayer player_;
 };
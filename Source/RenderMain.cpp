@@ -0,0 +1,94 @@
+/*
+  ==============================================================================
+
+    RenderMain.cpp
+    Created: 17 Oct 2026 2:12:08pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "OfflineRenderer.h"
+
+// Command line entry point for the offline renderer. Renders each MIDI
+// (or VGM) file given to a WAV file of the same name, several at once.
+
+static void printUsage()
+{
+    std::cout << "Usage: GameBoySynthRender [options] file.mid|file.vgm [...]" << std::endl
+              << "  --output DIR   write the WAV files here (default: next to each MIDI file)" << std::endl
+              << "  --jobs N       number of files to render at once (default: one per CPU)" << std::endl
+              << "  --chips N      number of emulated chips, 1 to " << MAX_CHIPS << " (default: 1)" << std::endl
+              << "  --rate HZ      sample rate (default: 44100)" << std::endl
+              << "  --tail SEC     time to keep rendering after the last event (default: 1)" << std::endl
+              << "  --quality Q    standard, low, medium, good or high (default: high)" << std::endl
+              << "  --mono         render a single channel" << std::endl
+              << "  --vgm          also write the first chip's register writes to a VGM file" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ArgumentList args(argc, argv);
+    if (args.size() == 0 || args.containsOption("--help|-h")) {
+        printUsage();
+        return args.size() == 0 ? 1 : 0;
+    }
+
+    RenderSettings settings;
+    if (args.containsOption("--rate")) settings.sampleRate = args.getValueForOption("--rate").getDoubleValue();
+    if (args.containsOption("--tail")) settings.tailSeconds = args.getValueForOption("--tail").getDoubleValue();
+    if (args.containsOption("--chips")) settings.chips = args.getValueForOption("--chips").getIntValue();
+    bool badQuality = false;
+    if (args.containsOption("--quality")) {
+        static const juce::StringArray qualities = { "standard", "low", "medium", "good", "high" };
+        int quality = qualities.indexOf(args.getValueForOption("--quality"));
+        badQuality = quality < 0;
+        settings.quality = (SynthQuality) std::max(quality, 0);
+    }
+    if (args.removeOptionIfFound("--mono")) settings.channels = 1;
+    if (args.removeOptionIfFound("--vgm")) settings.vgm = true;
+    int jobs = juce::SystemStats::getNumCpus();
+    if (args.containsOption("--jobs")) jobs = args.getValueForOption("--jobs").getIntValue();
+    juce::File outputDir;
+    if (args.containsOption("--output")) {
+        outputDir = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--output"));
+        if (!outputDir.createDirectory()) {
+            std::cerr << "Couldn't create " << outputDir.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+
+    if (settings.sampleRate <= 0 || settings.chips < 1 || settings.chips > MAX_CHIPS || jobs < 1 || badQuality) {
+        printUsage();
+        return 1;
+    }
+    // with several chips the renderers already spread across cores
+    jobs = std::max(1, jobs / settings.chips);
+
+    for (auto option : { "--rate", "--tail", "--chips", "--jobs", "--output", "--quality" }) {
+        args.removeValueForOption(option);
+    }
+
+    juce::ThreadPool pool(jobs);
+    juce::OwnedArray<OfflineRenderJob> renders;
+    for (int i = 0; i < args.size(); i++) {
+        juce::File midiFile = args[i].resolveAsFile();
+        juce::File dir = outputDir == juce::File() ? midiFile.getParentDirectory() : outputDir;
+        juce::File wavFile = dir.getChildFile(midiFile.getFileNameWithoutExtension() + ".wav");
+        renders.add(new OfflineRenderJob(settings, midiFile, wavFile));
+        pool.addJob(renders.getLast(), false);
+    }
+
+    int failed = 0;
+    for (auto* render : renders) {
+        pool.waitForJobToFinish(render, -1);
+        if (render->error.isEmpty()) {
+            std::cout << render->wavFile.getFullPathName() << std::endl;
+        } else {
+            std::cerr << render->error << std::endl;
+            failed++;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
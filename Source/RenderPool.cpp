@@ -0,0 +1,84 @@
+/*
+  ==============================================================================
+
+    RenderPool.cpp
+    Created: 17 Oct 2026 11:40:31am
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#include "RenderPool.h"
+
+RenderPool::RenderPool() : numWorkers_(0), job_(nullptr), context_(nullptr), unclaimed_(0), remaining_(0) {}
+
+RenderPool::~RenderPool()
+{
+    for (int i = 0; i < numWorkers_.load(); i++) {
+        threads_[i]->shutdown();
+    }
+}
+
+void RenderPool::ensureWorkers(int numWorkers)
+{
+    numWorkers = std::min(numWorkers, (int) MAX_WORKERS);
+    int current = numWorkers_.load();
+    for (int i = current; i < numWorkers; i++) {
+        threads_[i] = std::make_unique<Worker>(*this);
+        // the audio thread waits on them, so they mustn't be preempted
+        // by anything it wouldn't be
+        threads_[i]->startThread(juce::Thread::realtimeAudioPriority);
+    }
+    // only publish the new workers once they exist
+    if (numWorkers > current) numWorkers_.store(numWorkers);
+}
+
+void RenderPool::run(int count, Job job, void* context)
+{
+    if (count <= 0) return;
+    job_ = job;
+    context_ = context;
+    remaining_.store(count);
+    // publishes the job to the workers
+    unclaimed_.store(count);
+
+    int helpers = std::min(numWorkers_.load(), count - 1);
+    for (int i = 0; i < helpers; i++) {
+        threads_[i]->wake();
+    }
+    work();
+    // barrier: every index has been claimed, so only wait for the ones
+    // the workers are still rendering. A worker which hasn't woken up
+    // yet holds nothing up.
+    while (remaining_.load() > 0) {
+        juce::Thread::yield();
+    }
+}
+
+void RenderPool::work()
+{
+    for (;;) {
+        int i = unclaimed_.fetch_sub(1) - 1;
+        if (i < 0) return;
+        job_(context_, i);
+        remaining_.fetch_sub(1);
+    }
+}
+
+RenderPool::Worker::Worker(RenderPool& pool) : juce::Thread("RenderPool worker"), pool_(pool) {}
+
+void RenderPool::Worker::run()
+{
+    while (!threadShouldExit()) {
+        start_.wait(-1);
+        if (threadShouldExit()) return;
+        pool_.work();
+    }
+}
+
+void RenderPool::Worker::shutdown()
+{
+    signalThreadShouldExit();
+    wake();
+    stopThread(1000);
+}
@@ -0,0 +1,67 @@
+/*
+  ==============================================================================
+
+    RenderPool.h
+    Created: 17 Oct 2026 11:40:31am
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// A fixed set of worker threads which run one job over a range of indices
+// in parallel. The calling thread takes part in the work and run() doesn't
+// return until every index is done, so it acts as a barrier once per call.
+// Workers are only ever added, and must be added from a thread other than
+// the one calling run() (i.e. the message thread).
+class RenderPool
+{
+public:
+    static const int MAX_WORKERS = 15;
+
+    typedef void (*Job)(void* context, int index);
+
+    RenderPool();
+    ~RenderPool();
+
+    // Start workers until there are at least numWorkers of them
+    void ensureWorkers(int numWorkers);
+    int workers() const { return numWorkers_.load(); }
+
+    // Call job(context, i) for every i in [0, count). Doesn't allocate.
+    void run(int count, Job job, void* context);
+
+private:
+    class Worker : public juce::Thread
+    {
+    public:
+        Worker(RenderPool& pool);
+        void run() override;
+        void wake() { start_.signal(); }
+        void shutdown();
+
+    private:
+        RenderPool& pool_;
+        juce::WaitableEvent start_;
+    };
+
+    void work();
+
+    std::unique_ptr<Worker> threads_[MAX_WORKERS];
+    std::atomic<int> numWorkers_;
+
+    // the job currently being run
+    Job job_;
+    void* context_;
+    // indices of the current job which haven't been claimed yet. They're
+    // claimed from the top down, so that a worker which only wakes up
+    // after its job is over finds nothing left rather than a stale index
+    std::atomic<int> unclaimed_;
+    // indices of the current job which haven't finished yet
+    std::atomic<int> remaining_;
+
+    JUCE_DECLARE_NON_COPYABLE(RenderPool)
+};
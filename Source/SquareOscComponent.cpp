@@ -15,7 +15,7 @@
 
 
 //==============================================================================
-SquareOscComponent::SquareOscComponent(OSCID id) : controls(id)
+SquareOscComponent::SquareOscComponent(Synth& synth, OSCID id) : controls(synth, id)
 {
     addAndMakeVisible(controls);
 }
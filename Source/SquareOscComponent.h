@@ -19,7 +19,7 @@
 class SquareOscComponent  : public juce::Component
 {
 public:
-    SquareOscComponent(OSCID id);
+    SquareOscComponent(Synth& synth, OSCID id);
     ~SquareOscComponent() override;
 
     void paint(juce::Graphics&) override;
@@ -15,24 +15,55 @@ Apu::Apu()
     stereo_ = true;
     buf_ = &sbuf_; // default streo
     clock_ = 0;
+    maxSamples_ = 0;
+    numPending_ = 0;
+    frameStart_ = 0;
+    std::memset(registers_, 0, sizeof(registers_));
+    recorder_ = nullptr;
+    recordedSession_ = 0;
 }
 
 Apu::~Apu() {}
 
-void Apu::configure(double sampleRate, int channels)
+// Room for two blocks, since a frame which went past the end of one block
+// leaves samples for the next, plus the time a full queue of writes at the
+// end of a block can carry a frame past it.
+int Apu::bufferLength(double sampleRate, int samplesPerBlock)
+{
+    double carry = (double) (MAX_PENDING_WRITES * CLOCKS_PER_INSTRUCTION) / CLOCK_SPEED;
+    return (int) std::ceil((2 * samplesPerBlock / sampleRate + carry) * 1000.0);
+}
+
+long Apu::memorySize(double sampleRate, int channels, int samplesPerBlock)
+{
+    int msec = bufferLength(sampleRate, samplesPerBlock);
+    if (channels == 1) return Mono_Buffer::memory_size((long) sampleRate, msec);
+    return Stereo_Buffer::memory_size((long) sampleRate, msec);
+}
+
+void Apu::configure(double sampleRate, int channels, int samplesPerBlock, Blip_Buffer::buf_t_* memory)
 {
     stereo_ = channels != 1;
+    maxSamples_ = samplesPerBlock;
+    if (memory == nullptr) {
+        memory_.allocate((size_t) memorySize(sampleRate, channels, samplesPerBlock), false);
+        memory = memory_.get();
+    } else {
+        memory_.free();
+    }
+    int msec = bufferLength(sampleRate, samplesPerBlock);
     if (stereo_) {
         buf_ = &sbuf_;
+        sbuf_.set_sample_rate((long) sampleRate, msec, memory);
         apu_.output(sbuf_.center(), sbuf_.left(), sbuf_.right());
-
     } else {
         buf_ = &mbuf_;
+        mbuf_.set_sample_rate((long) sampleRate, msec, memory);
         apu_.output(mbuf_.center());
     }
     buf_->clock_rate(CLOCK_SPEED);
-    blargg_err_t res = buf_->set_sample_rate((long) sampleRate);
-    jassert(res == blargg_success);
+    // also resets the stereo flags, which the constructor doesn't
+    buf_->clear();
     // Adjust frequency equalization to make it sound like a tiny speaker
     // TODO: expose these parameters
     apu_.treble_eq(-20.0); // lower values muffle it more
@@ -40,16 +71,80 @@ void Apu::configure(double sampleRate, int channels)
     writeRegister(NR52, 0x80); // turn on
 }
 
+void Apu::setQuality(SynthQuality quality)
+{
+    if (quality == SynthQuality::standard) {
+        apu_.quality(blip_good_quality, blip_med_quality);
+    } else {
+        // the other levels are in the same order as blargg's
+        apu_.quality(blip_low_quality + (int) quality - (int) SynthQuality::low);
+    }
+}
+
+void Apu::setSampleTime(long samplePosition)
+{
+    // samples already sitting in the buffer can't be changed anymore
+    if (samplePosition <= samplesAvailable()) return;
+    // never move backwards, the APU can only run forwards in time
+    clock_ = std::max(clock_, center()->count_clocks(samplePosition));
+}
+
 void Apu::writeRegister(gb_addr_t addr, uint8_t data)
 {
-    apu_.write_register(tick(), addr, data);
+    queueWrite(tick(), addr, data);
+}
+
+void Apu::writeRegisterAt(blip_time_t time, gb_addr_t addr, uint8_t data)
+{
+    // the APU can only run forwards, so a write before the last one
+    // happens at the same time as it
+    clock_ = std::max(clock_, time);
+    queueWrite(clock_, addr, data);
+}
+
+void Apu::queueWrite(blip_time_t time, gb_addr_t addr, uint8_t data)
+{
+    if (numPending_ == MAX_PENDING_WRITES) flushWrites();
+    RegisterWrite& w = pending_[numPending_++];
+    w.time = time;
+    w.addr = addr;
+    w.data = data;
 }
 
 uint8_t Apu::readRegister(gb_addr_t addr)
 {
+    flushWrites();
     return apu_.read_register(tick(), addr);
 }
 
+void Apu::flushWrites()
+{
+    if (recorder_ != nullptr) record();
+    for (int i = 0; i < numPending_; i++) {
+        const RegisterWrite& w = pending_[i];
+        apu_.write_register(w.time, w.addr, w.data);
+        if (w.addr >= Gb_Apu::start_addr && w.addr <= Gb_Apu::end_addr) {
+            registers_[w.addr - Gb_Apu::start_addr] = w.data;
+        }
+    }
+    numPending_ = 0;
+}
+
+void Apu::record()
+{
+    int session = recorder_->session();
+    if (session != recordedSession_) {
+        recordedSession_ = session;
+        // a new recording starts from the registers as they are now
+        if (session != 0) recorder_->begin(session, frameStart_, registers_);
+    }
+    if (session == 0) return;
+    for (int i = 0; i < numPending_; i++) {
+        const RegisterWrite& w = pending_[i];
+        recorder_->write(frameStart_ + w.time, w.addr, w.data);
+    }
+}
+
 inline long Apu::samplesAvailable()
 {
     if (stereo_) {
@@ -58,41 +153,58 @@ inline long Apu::samplesAvailable()
     return mbuf_.samples_avail();
 }
 
-void Apu::readSamples(juce::AudioBuffer<float>* out)
+void Apu::readSamples(juce::AudioBuffer<float>* out, int startSample, int numSamples)
 {
-    // TODO: is it a performance problem to simulate and read in very small steps?
-    // is this better than double buffering?
-    long sampleCount = out->getNumSamples();
     jassert( (stereo_ && out->getNumChannels() == 2) || (out->getNumChannels() == 1) );
-    long read = 0;
-    int channelCount = stereo_ ? 2 : 1;
-    while (read < sampleCount) {
-        while (!samplesAvailable()) {
-            bool stereo = apu_.end_frame(tick());
-            buf_->end_frame(clock_, stereo);
-        }
-        buf_->read_samples(samples_, channelCount);
-        for (int c = 0; c < channelCount; c++) {
-            out->getWritePointer(c)[read] = ((float) samples_[c]) / 0x7FFF;
-        }
-        read++;
+    jassert(maxSamples_ > 0); // configure() must be called first
+    // the buffers mix straight into the output as floats
+    float* dest[2] = { nullptr, nullptr };
+    for (int c = 0; c < out->getNumChannels(); c++) {
+        dest[c] = out->getWritePointer(c, startSample);
     }
+    endFrame(numSamples);
+    long n = buf_->read_samples(dest, numSamples);
+    jassert(n == numSamples);
+    juce::ignoreUnused(n);
+}
+
+// Run the emulator just far enough that sampleCount samples can be read
+// and end the frame there. Register writes are timestamped relative to the
+// start of the frame, so the clock starts over afterwards.
+void Apu::endFrame(long sampleCount)
+{
+    flushWrites();
+    if (samplesAvailable() >= sampleCount) return;
+    // writes may have been scheduled past the end of the block,
+    // in which case they carry the frame a little further
+    blip_time_t clocks = std::max(center()->count_clocks(sampleCount), clock_);
+    bool stereo = apu_.end_frame(clocks);
+    buf_->end_frame(clocks, stereo);
+    frameStart_ += clocks;
     clock_ = 0;
 }
 
 void Apu::reset()
 {
     writeRegister(NR52, 0x00); // turn off
-    sbuf_.clear();
-    mbuf_.clear();
+    flushWrites();
+    if (maxSamples_ > 0) {
+        // end the frame at the last write, so that everything written
+        // is in the samples waiting and only those need clearing
+        bool stereo = apu_.end_frame(clock_);
+        buf_->end_frame(clock_, stereo);
+        frameStart_ += clock_;
+        buf_->clear(false);
+    }
     clock_ = 0;
     apu_.reset();
+    std::memset(registers_, 0, sizeof(registers_));
 }
 
-uint16_t Oscillator::midiNoteToPeriod(uint8_t note)
+uint16_t Oscillator::midiNoteToPeriod(uint8_t note) const
 {
 //    double frequency = pow(2, ((double)(note)-69)/12) * 440.0;
-    double frequency = juce::MidiMessage::getMidiNoteInHertz(note);
+    double frequency = juce::MidiMessage::getMidiNoteInHertz(note) * pitch_;
 
     // Note: notes below #36 will wrap around. I am choosing to consider this
     // the desired behavior
@@ -109,6 +221,8 @@ uint8_t Oscillator::midiVelocityTo4BitVolume(uint8_t velocity)
 void Oscillator::set11BitPeriod(uint8_t note)
 {
     uint16_t period = midiNoteToPeriod(note);
+    note_ = note;
+    period_ = period;
     apu_->writeRegister(startAddr_ + NRX3, (uint8_t)(period & 0xff));
     // TODO: always triggering, is this expected?
     // TODO: doesn't deal with length enable, although it seems like the emulator ignores
@@ -122,9 +236,8 @@ void Oscillator::set11BitPeriod(uint8_t note)
 void Oscillator::setVolumeEnvelope(uint8_t startVelocity, bool increasing, uint8_t period)
 {
     jassert(id_ != 2);
-    uint8_t v = midiVelocityTo4BitVolume(startVelocity);
-    v = (uint8_t)((float) v * volume); // scaled
-    apu_->writeRegister(startAddr_ + NRX2, v << 4 | (increasing ? 0x08 : 0x00) | (period & 0x03));
+    uint8_t v = scaledVolume(startVelocity);
+    writeVolume(v << 4 | (increasing ? 0x08 : 0x00) | (period & 0x03));
 }
 
 void Oscillator::setConstantVolume(uint8_t velocity)
@@ -132,6 +245,63 @@ void Oscillator::setConstantVolume(uint8_t velocity)
     setVolumeEnvelope(velocity, false, 0);
 }
 
+void Oscillator::writeVolume(uint8_t data)
+{
+    apu_->writeRegister(startAddr_ + NRX2, data);
+    volumeRegister_ = data;
+}
+
+// the 4 bit volume for velocity, scaled by the volume setting and the
+// tremolo. The tremolo never takes an audible note down to 0, since an
+// NRX2 of 0 turns the channel's DAC off until it's triggered again.
+uint8_t Oscillator::scaledVolume(uint8_t velocity) const
+{
+    float v = (float) midiVelocityTo4BitVolume(velocity) * volume;
+    uint8_t scaled = (uint8_t)(v * level_);
+    if (scaled == 0 && v >= 1.0f) return 1;
+    return scaled;
+}
+
+uint8_t Oscillator::volumeRegister() const
+{
+    // notes are always played at a constant volume
+    return scaledVolume(velocity_) << 4;
+}
+
+void Oscillator::modulate(double pitch, float level)
+{
+    if (pitch == pitch_ && level == level_) return;
+    pitch_ = pitch;
+    level_ = level;
+    if (velocity_ == 0) return;
+    // On hardware a square or noise channel only loads a new NRX2 volume
+    // when it's triggered (the emulator applies it straight away), so
+    // those are retriggered. That doesn't reset the square's duty step.
+    // The wave channel's NR32 takes effect at once.
+    bool retrigger = false;
+    uint8_t v = volumeRegister();
+    if (v != volumeRegister_) {
+        writeVolume(v);
+        retrigger = id_ != 2;
+    }
+    if (id_ == 3) {
+        // the noise has no period
+        if (retrigger) apu_->writeRegister(startAddr_ + NRX4, 0x80);
+        return;
+    }
+    uint16_t period = midiNoteToPeriod(note_);
+    if (period == period_ && !retrigger) return;
+    // otherwise the trigger bit is left clear, so the note carries on
+    // where it is
+    if ((period & 0xff) != (period_ & 0xff)) {
+        apu_->writeRegister(startAddr_ + NRX3, (uint8_t)(period & 0xff));
+    }
+    if (retrigger || (period >> 8) != (period_ >> 8)) {
+        apu_->writeRegister(startAddr_ + NRX4, (uint8_t)(period >> 8) | (retrigger ? 0x80 : 0x00));
+    }
+    period_ = period;
+}
+
 Oscillator::~Oscillator() {};
 
 void SquareOscilator::setDuty(DutyCycle duty)
@@ -144,16 +314,19 @@ void SquareOscilator::setDuty(DutyCycle duty)
 void SquareOscilator::setEvent(MidiEvent event)
 {
     if (event.note < 36 || event.note > 108) {
+        velocity_ = 0;
         setConstantVolume(0); // ignore it
         return;
     }
+    velocity_ = event.velocity;
     setConstantVolume(event.velocity);
     set11BitPeriod(event.note);
 }
 
 void SquareOscilator::afterInit()
 {
-    setDuty(duty_);
+    // always written, since the APU may have been reset
+    apu_->writeRegister(startAddr_ + NRX1, (uint8_t) duty_ << 6);
     apu_->writeRegister(startAddr_ + NRX0, 0x00); // disable sweep
 }
 
@@ -172,16 +345,23 @@ GBWaveVolume WaveOscillator::midiVelocityToWaveVolume(uint8_t velocity)
 
 void WaveOscillator::setVelocity(uint8_t velocity)
 {
-    uint8_t vol = (uint8_t) midiVelocityToWaveVolume(velocity);
-    apu_->writeRegister(startAddr_ + NRX2, vol << 5);
+    velocity_ = velocity;
+    writeVolume(volumeRegister());
 }
 
-void WaveOscillator::setWaveTable(uint8_t* samples)
+uint8_t WaveOscillator::volumeRegister() const
+{
+    uint8_t vol = (uint8_t) midiVelocityToWaveVolume((uint8_t)((float) velocity_ * level_));
+    return vol << 5;
+}
+
+void WaveOscillator::setWaveTable(const uint8_t* samples)
 {
     // TODO: pandocs say you should only change the wavetable while the osc is off
     // apu_->writeRegister(startAddr_ + NRX0, 0x00);
+    if (samples != wavetable_) std::memcpy(wavetable_, samples, WAVE_TABLE_SIZE);
     for (uint16_t i = 0; i < 32; i += 2) {
-        uint8_t value = ((*(samples+i) & 0x0F) << 4) | (*(samples+i+1) & 0x0F);
+        uint8_t value = ((wavetable_[i] & 0x0F) << 4) | (wavetable_[i+1] & 0x0F);
         apu_->writeRegister(WaveTableAddr + i / 2, value);
     }
 }
@@ -199,6 +379,7 @@ void WaveOscillator::setEvent(MidiEvent event)
 void WaveOscillator::afterInit()
 {
     apu_->writeRegister(startAddr_ + NRX0, 0x80); // enable the dac
+    setWaveTable(wavetable_);
 }
 
 void NoiseOscillator::setEvent(MidiEvent event)
@@ -211,112 +392,820 @@ void NoiseOscillator::afterInit()
     // TODO
 }
 
+Modulator::Modulator()
+{
+    LfoSettings off = { 1.0f, 0.0f };
+    for (OSCID i = 0; i < NUM_OSC; i++) {
+        vibrato_[i] = off;
+        tremolo_[i] = off;
+        vibratoPhase_[i] = 0.0;
+        tremoloPhase_[i] = 0.0;
+        pitch_[i] = 1.0;
+        level_[i] = 1.0f;
+    }
+    rate_ = ControlRate::hz256;
+    sampleRate_ = 44100.0;
+    tempo_ = 120.0;
+    nextTick_ = 0.0;
+    updateTickLength();
+}
+
+void Modulator::configure(double sampleRate)
+{
+    sampleRate_ = sampleRate;
+    nextTick_ = 0.0;
+    updateTickLength();
+}
+
+void Modulator::setRate(ControlRate rate)
+{
+    rate_ = rate;
+    updateTickLength();
+}
+
+void Modulator::setTempo(double bpm)
+{
+    if (bpm <= 0.0 || bpm == tempo_) return;
+    tempo_ = bpm;
+    updateTickLength();
+}
+
+void Modulator::updateTickLength()
+{
+    double secondsPerBeat = 60.0 / tempo_;
+    double seconds = 1.0;
+    switch (rate_) {
+        case ControlRate::hz64: seconds = 1.0 / 64; break;
+        case ControlRate::hz128: seconds = 1.0 / 128; break;
+        case ControlRate::hz256: seconds = 1.0 / 256; break;
+        case ControlRate::sixteenths: seconds = secondsPerBeat / 4; break;
+        case ControlRate::thirtySeconds: seconds = secondsPerBeat / 8; break;
+        case ControlRate::sixtyFourths: seconds = secondsPerBeat / 16; break;
+    }
+    samplesPerTick_ = seconds * sampleRate_;
+}
+
+bool Modulator::nextTick(int samplePosition, int& tickPosition)
+{
+    if (nextTick_ >= samplePosition) return false;
+    tickPosition = std::max(0, (int) nextTick_);
+    double seconds = samplesPerTick_ / sampleRate_;
+    nextTick_ += samplesPerTick_;
+    // one pass over the oscillators per tick. The LFOs start in the
+    // middle of the pitch and at the top of the volume.
+    const double twoPi = juce::MathConstants<double>::twoPi;
+    for (OSCID i = 0; i < NUM_OSC; i++) {
+        const LfoSettings& vibrato = vibrato_[i];
+        const LfoSettings& tremolo = tremolo_[i];
+        pitch_[i] = 1.0;
+        if (vibrato.depth > 0.0f) {
+            double semitones = vibrato.depth * std::sin(twoPi * vibratoPhase_[i]);
+            pitch_[i] = std::exp2(semitones / 12.0);
+        }
+        level_[i] = 1.0f;
+        if (tremolo.depth > 0.0f) {
+            double dip = 0.5 - 0.5 * std::cos(twoPi * tremoloPhase_[i]);
+            level_[i] = (float) (1.0 - tremolo.depth * dip);
+        }
+        vibratoPhase_[i] += vibrato.rate * seconds;
+        vibratoPhase_[i] -= std::floor(vibratoPhase_[i]);
+        tremoloPhase_[i] += tremolo.rate * seconds;
+        tremoloPhase_[i] -= std::floor(tremoloPhase_[i]);
+    }
+    return true;
+}
+
+void ChannelVoices::reset()
+{
+    lru.reset();
+    lowest.reset();
+    highest.reset();
+    roundRobin.reset();
+    noSteal.reset();
+}
+
+void ChannelVoices::setVoices(size_t voices)
+{
+    lru.setVoices(voices);
+    lowest.setVoices(voices);
+    highest.setVoices(voices);
+    roundRobin.setVoices(voices);
+    noSteal.setVoices(voices);
+}
+
 Synth::Synth()
 {
+    numChips_ = 1;
+    maxBlockSize_ = 0;
+    buffersSize_ = 0;
+    policy_ = VoicePolicy::leastRecentlyUsed;
+    enabled_ = 0;
+    mixer_ = -1;
+    resync_ = false;
+    for (int ch = 0; ch < 16; ch++) {
+        channelIndex_[ch] = -1;
+    }
+    forgetSent();
+    chips_[0].apu.setRecorder(&recorder_);
     setDefaults();
+    // nothing else can be using it yet
+    processCommands();
 }
 
-void Synth::configure(double sampleRate, int channels)
+void Synth::configure(double sampleRate, int channels, int samplesPerBlock)
 {
-    apu_.configure(sampleRate, channels);
+    // all the chips are prepared up front so that switching to
+    // polyphonic mode doesn't need to allocate on the audio thread
+    long size = Apu::memorySize(sampleRate, channels, samplesPerBlock);
+    if (size * MAX_CHIPS != buffersSize_) {
+        buffersSize_ = size * MAX_CHIPS;
+        buffers_.allocate((size_t) buffersSize_, false);
+    }
+    for (int c = 0; c < MAX_CHIPS; c++) {
+        chips_[c].apu.configure(sampleRate, channels, samplesPerBlock, buffers_ + c * size);
+        chipBuffers_[c].setSize(channels, samplesPerBlock);
+    }
+    maxBlockSize_ = samplesPerBlock;
+    mixer_ = -1;
+    updateMixer();
+    modulator_.configure(sampleRate);
 }
 
+// the LFOs are off, but have a typical rate ready for when they're turned up
+static const LfoSettings VIBRATO_OFF = { 5.5f, 0.0f };
+static const LfoSettings TREMOLO_OFF = { 4.0f, 0.0f };
+
 void Synth::setDefaults()
 {
+    SynthParameters p;
     for (OSCID i = 0; i < NUM_OSC; i++) {
-        oscs_[i]->setApu(&apu_);
-        configs_[i].enabled = false;
-        configs_[i].channel = 0;
-        configs_[i].voice = 0;
-        reconfigure(i);
+        // the two square oscillators play two-voice harmony
+        p.configs[i].enabled = i == 0 || i == 1;
+        p.configs[i].channel = 0;
+        p.configs[i].voice = i == 1 ? 1 : 0;
+        p.configs[i].transpose = 0;
+        p.volume[i] = 1.0f;
     }
+    p.duty[0] = p.duty[1] = DutyCycle::duty50;
+    std::memcpy(p.wavetable, WAVE_TABLE_SINE, WAVE_TABLE_SIZE);
+    p.chips = 1;
+    p.policy = VoicePolicy::leastRecentlyUsed;
+    p.quality = SynthQuality::standard;
+    for (OSCID i = 0; i < NUM_OSC; i++) {
+        p.vibrato[i] = VIBRATO_OFF;
+        p.tremolo[i] = TREMOLO_OFF;
+    }
+    p.controlRate = ControlRate::hz256;
+    setParameters(p);
 }
 
 void Synth::stop()
 {
-    apu_.reset();
+    for (int c = 0; c < MAX_CHIPS; c++) {
+        chips_[c].apu.reset();
+        // write the oscillators' settings back to the cleared registers
+        for (OSCID i = 0; i < NUM_OSC; i++) {
+            chips_[c].oscs[i]->setApu(&chips_[c].apu);
+        }
+    }
+    // the reset cleared every register
+    mixer_ = -1;
+    forgetSent();
 }
 
 void Synth::setEnabled(OSCID oscillator, bool enabled)
 {
     jassert(oscillator < NUM_OSC);
-    configs_[oscillator].enabled = enabled;
-    reconfigure(oscillator);
+    SynthCommand c;
+    c.type = SynthCommand::Type::setEnabled;
+    c.oscillator = oscillator;
+    c.enabled = enabled;
+    parameters_.configs[oscillator].enabled = enabled;
+    post(c);
 }
 
 void Synth::setTranspose(OSCID oscillator, int8_t transpose)
 {
     jassert(oscillator < NUM_OSC);
-    configs_[oscillator].transpose = transpose;
-    reconfigure(oscillator);
+    SynthCommand c;
+    c.type = SynthCommand::Type::setTranspose;
+    c.oscillator = oscillator;
+    c.transpose = transpose;
+    parameters_.configs[oscillator].transpose = transpose;
+    post(c);
 }
 
 void Synth::setMIDIVoice(OSCID oscillator, uint8_t voice)
 {
     jassert(oscillator < NUM_OSC);
-    configs_[oscillator].voice = voice;
-    reconfigure(oscillator);
+    SynthCommand c;
+    c.type = SynthCommand::Type::setMIDIVoice;
+    c.oscillator = oscillator;
+    c.voice = voice;
+    parameters_.configs[oscillator].voice = voice;
+    post(c);
 }
 
 void Synth::setMIDIChannel(OSCID oscillator, uint8_t channel)
 {
     jassert(oscillator < NUM_OSC);
-    configs_[oscillator].channel = channel & 0x0F;
-    reconfigure(oscillator);
+    SynthCommand c;
+    c.type = SynthCommand::Type::setMIDIChannel;
+    c.oscillator = oscillator;
+    c.channel = channel & 0x0F;
+    parameters_.configs[oscillator].channel = c.channel;
+    post(c);
+}
+
+void Synth::setDutyCycle(OSCID oscillator, double value)
+{
+    jassert(oscillator == 0 || oscillator == 1);
+    SynthCommand c;
+    c.type = SynthCommand::Type::setDutyCycle;
+    c.oscillator = oscillator;
+    c.value = value;
+    parameters_.duty[oscillator] = SquareOscilator::dutyCycleFromValue(value);
+    post(c);
+}
+
+void Synth::setVolume(OSCID oscillator, double value)
+{
+    jassert(oscillator < NUM_OSC);
+    jassert(value >= 0.0 && value <= 1.0);
+    SynthCommand c;
+    c.type = SynthCommand::Type::setVolume;
+    c.oscillator = oscillator;
+    c.value = value;
+    parameters_.volume[oscillator] = (float) value;
+    post(c);
+}
+
+void Synth::setChipCount(int chips)
+{
+    jassert(chips >= 1 && chips <= MAX_CHIPS);
+    // the extra chips are rendered on worker threads, which have to be
+    // started here rather than on the audio thread
+    int cpus = juce::SystemStats::getNumCpus();
+    pool_.ensureWorkers(std::min(chips, cpus) - 1);
+    SynthCommand c;
+    c.type = SynthCommand::Type::setChipCount;
+    c.oscillator = 0;
+    c.chips = (uint8_t) chips;
+    parameters_.chips = c.chips;
+    post(c);
+}
+
+void Synth::setVoicePolicy(VoicePolicy policy)
+{
+    SynthCommand c;
+    c.type = SynthCommand::Type::setVoicePolicy;
+    c.oscillator = 0;
+    c.policy = policy;
+    parameters_.policy = policy;
+    post(c);
+}
+
+void Synth::setQuality(SynthQuality quality)
+{
+    SynthCommand c;
+    c.type = SynthCommand::Type::setQuality;
+    c.oscillator = 0;
+    c.quality = quality;
+    parameters_.quality = quality;
+    post(c);
+}
+
+void Synth::setVibrato(OSCID oscillator, LfoSettings lfo)
+{
+    jassert(oscillator < NUM_OSC);
+    jassert(lfo.rate >= 0.0f && lfo.depth >= 0.0f);
+    SynthCommand c;
+    c.type = SynthCommand::Type::setVibrato;
+    c.oscillator = oscillator;
+    c.lfo = lfo;
+    parameters_.vibrato[oscillator] = lfo;
+    post(c);
+}
+
+void Synth::setTremolo(OSCID oscillator, LfoSettings lfo)
+{
+    jassert(oscillator < NUM_OSC);
+    jassert(lfo.rate >= 0.0f && lfo.depth >= 0.0f && lfo.depth <= 1.0f);
+    SynthCommand c;
+    c.type = SynthCommand::Type::setTremolo;
+    c.oscillator = oscillator;
+    c.lfo = lfo;
+    parameters_.tremolo[oscillator] = lfo;
+    post(c);
+}
+
+void Synth::setControlRate(ControlRate rate)
+{
+    SynthCommand c;
+    c.type = SynthCommand::Type::setControlRate;
+    c.oscillator = 0;
+    c.controlRate = rate;
+    parameters_.controlRate = rate;
+    post(c);
+}
+
+void Synth::setWaveTable(const uint8_t* samples)
+{
+    SynthCommand c;
+    c.type = SynthCommand::Type::setWaveTable;
+    c.oscillator = 2;
+    std::memcpy(c.wavetable, samples, WAVE_TABLE_SIZE);
+    std::memcpy(parameters_.wavetable, samples, WAVE_TABLE_SIZE);
+    post(c);
+}
+
+void Synth::setParameters(const SynthParameters& parameters)
+{
+    jassert(parameters.chips >= 1 && parameters.chips <= MAX_CHIPS);
+    // as in setChipCount, the workers can't be started on the audio thread
+    int cpus = juce::SystemStats::getNumCpus();
+    pool_.ensureWorkers(std::min((int) parameters.chips, cpus) - 1);
+    SynthCommand c;
+    c.type = SynthCommand::Type::setParameters;
+    c.oscillator = 0;
+    c.parameters = parameters;
+    parameters_ = parameters;
+    post(c);
+}
+
+// The state is a magic number and version followed by each field
+// in a fixed order. Later versions may only add fields at the end,
+// so that any version can read the fields it knows about.
+static const int STATE_MAGIC = 0x79534247; // "GBSy"
+static const uint8_t STATE_VERSION = 3;
+// version 1 ended at the voice policy, version 2 at the quality
+static const int STATE_SIZE_V1 = 4 + 1 + NUM_OSC * 8 + 2 + WAVE_TABLE_SIZE + 2;
+static const int STATE_SIZE_V2 = STATE_SIZE_V1 + 1;
+static const int STATE_SIZE = STATE_SIZE_V2 + NUM_OSC * 16 + 1;
+
+void Synth::saveState(juce::MemoryBlock& destData) const
+{
+    const SynthParameters& p = parameters_;
+    juce::MemoryOutputStream out(destData, false);
+    out.preallocate(STATE_SIZE);
+    out.writeInt(STATE_MAGIC);
+    out.writeByte((char) STATE_VERSION);
+    for (OSCID i = 0; i < NUM_OSC; i++) {
+        out.writeBool(p.configs[i].enabled);
+        out.writeByte((char) p.configs[i].channel);
+        out.writeByte((char) p.configs[i].voice);
+        out.writeByte((char) p.configs[i].transpose);
+        out.writeFloat(p.volume[i]);
+    }
+    out.writeByte((char) p.duty[0]);
+    out.writeByte((char) p.duty[1]);
+    out.write(p.wavetable, WAVE_TABLE_SIZE);
+    out.writeByte((char) p.chips);
+    out.writeByte((char) p.policy);
+    out.writeByte((char) p.quality);
+    for (OSCID i = 0; i < NUM_OSC; i++) {
+        out.writeFloat(p.vibrato[i].rate);
+        out.writeFloat(p.vibrato[i].depth);
+        out.writeFloat(p.tremolo[i].rate);
+        out.writeFloat(p.tremolo[i].depth);
+    }
+    out.writeByte((char) p.controlRate);
+    jassert(out.getPosition() == STATE_SIZE);
+}
+
+bool Synth::loadState(const void* data, int sizeInBytes)
+{
+    if (data == nullptr || sizeInBytes < STATE_SIZE_V1) return false;
+    juce::MemoryInputStream in(data, (size_t) sizeInBytes, false);
+    if (in.readInt() != STATE_MAGIC) return false;
+    uint8_t version = (uint8_t) in.readByte();
+    if (version < 1) return false;
+    if (version >= 2 && sizeInBytes < STATE_SIZE_V2) return false;
+    if (version >= 3 && sizeInBytes < STATE_SIZE) return false;
+
+    SynthParameters p;
+    for (OSCID i = 0; i < NUM_OSC; i++) {
+        p.configs[i].enabled = in.readBool();
+        p.configs[i].channel = (uint8_t) in.readByte() & 0x0F;
+        p.configs[i].voice = (uint8_t) in.readByte();
+        p.configs[i].transpose = (int8_t) in.readByte();
+        p.volume[i] = in.readFloat();
+        if (p.configs[i].voice >= NUM_OSC || !std::isfinite(p.volume[i])) return false;
+        p.volume[i] = juce::jlimit(0.0f, 1.0f, p.volume[i]);
+    }
+    for (int i = 0; i < 2; i++) {
+        p.duty[i] = (DutyCycle) ((uint8_t) in.readByte() & 0x03);
+    }
+    in.read(p.wavetable, WAVE_TABLE_SIZE);
+    for (int i = 0; i < WAVE_TABLE_SIZE; i++) {
+        p.wavetable[i] &= 0x0F;
+    }
+    p.chips = (uint8_t) in.readByte();
+    p.policy = (VoicePolicy) in.readByte();
+    if (p.chips < 1 || p.chips > MAX_CHIPS) return false;
+    if (p.policy > VoicePolicy::noSteal) return false;
+    p.quality = SynthQuality::standard;
+    if (version >= 2) {
+        p.quality = (SynthQuality) in.readByte();
+        if (p.quality > SynthQuality::high) return false;
+    }
+    // earlier versions had no modulation
+    for (OSCID i = 0; i < NUM_OSC; i++) {
+        p.vibrato[i] = VIBRATO_OFF;
+        p.tremolo[i] = TREMOLO_OFF;
+    }
+    p.controlRate = ControlRate::hz256;
+    if (version >= 3) {
+        for (OSCID i = 0; i < NUM_OSC; i++) {
+            p.vibrato[i].rate = in.readFloat();
+            p.vibrato[i].depth = in.readFloat();
+            p.tremolo[i].rate = in.readFloat();
+            p.tremolo[i].depth = in.readFloat();
+            if (!std::isfinite(p.vibrato[i].rate) || !std::isfinite(p.vibrato[i].depth)) return false;
+            if (!std::isfinite(p.tremolo[i].rate) || !std::isfinite(p.tremolo[i].depth)) return false;
+            p.vibrato[i].rate = juce::jlimit(0.0f, 100.0f, p.vibrato[i].rate);
+            p.vibrato[i].depth = juce::jlimit(0.0f, 12.0f, p.vibrato[i].depth);
+            p.tremolo[i].rate = juce::jlimit(0.0f, 100.0f, p.tremolo[i].rate);
+            p.tremolo[i].depth = juce::jlimit(0.0f, 1.0f, p.tremolo[i].depth);
+        }
+        p.controlRate = (ControlRate) in.readByte();
+        if (p.controlRate > ControlRate::sixtyFourths) return false;
+    }
+
+    setParameters(p);
+    return true;
+}
+
+// The setters have already updated parameters_, so a command which
+// doesn't fit in the queue isn't dropped: the audio thread is sent all
+// of parameters_ instead. Until it has picked them up, later changes
+// go the same way so that they aren't applied out of order.
+void Synth::post(const SynthCommand& command)
+{
+    if (!resync_ && commands_.push(command)) return;
+    const juce::SpinLock::ScopedLockType lock(resyncLock_);
+    resyncParameters_ = parameters_;
+    resync_ = true;
+}
+
+void Synth::processCommands()
+{
+    SynthCommand c;
+    while (commands_.pop(c)) {
+        apply(c);
+    }
+    if (resync_) {
+        // if the message thread is updating them, try again next block
+        const juce::SpinLock::ScopedTryLockType lock(resyncLock_);
+        if (lock.isLocked()) {
+            applyParameters(resyncParameters_);
+            resync_ = false;
+        }
+    }
+}
+
+void Synth::apply(const SynthCommand& c)
+{
+    switch (c.type) {
+        case SynthCommand::Type::setEnabled:
+            configs_[c.oscillator].enabled = c.enabled;
+            return reconfigure(c.oscillator);
+        case SynthCommand::Type::setTranspose:
+            configs_[c.oscillator].transpose = c.transpose;
+            return reconfigure(c.oscillator);
+        case SynthCommand::Type::setMIDIVoice:
+            configs_[c.oscillator].voice = c.voice;
+            return reconfigure(c.oscillator);
+        case SynthCommand::Type::setMIDIChannel:
+            configs_[c.oscillator].channel = c.channel;
+            return reconfigure(c.oscillator);
+        case SynthCommand::Type::setDutyCycle:
+        {
+            DutyCycle duty = SquareOscilator::dutyCycleFromValue(c.value);
+            for (int i = 0; i < MAX_CHIPS; i++) {
+                switch (c.oscillator)
+                {
+                    case 0: chips_[i].osc1.setDuty(duty); break;
+                    case 1: chips_[i].osc2.setDuty(duty); break;
+                    default: break;
+                }
+            }
+            return;
+        }
+        case SynthCommand::Type::setVolume:
+            for (int i = 0; i < MAX_CHIPS; i++) {
+                chips_[i].oscs[c.oscillator]->volume = c.value;
+            }
+            return;
+        case SynthCommand::Type::setWaveTable:
+            for (int i = 0; i < MAX_CHIPS; i++) {
+                chips_[i].osc3.setWaveTable(c.wavetable);
+            }
+            return;
+        case SynthCommand::Type::setChipCount:
+            // the chips which are going away won't be updated anymore,
+            // and the ones joining catch up with the LFOs
+            silence(c.chips);
+            for (int i = numChips_; i < c.chips; i++) {
+                modulate(i);
+            }
+            numChips_ = c.chips;
+            return reconfigure(c.oscillator);
+        case SynthCommand::Type::setVoicePolicy:
+            if (c.policy == policy_) return;
+            silence(0);
+            policy_ = c.policy;
+            // start from no keys held, whichever manager is used
+            for (int i = 0; i < NUM_OSC; i++) {
+                channelVoices_[i].reset();
+            }
+            return;
+        case SynthCommand::Type::setQuality:
+            for (int i = 0; i < MAX_CHIPS; i++) {
+                chips_[i].apu.setQuality(c.quality);
+            }
+            return;
+        case SynthCommand::Type::setVibrato:
+            return modulator_.setVibrato(c.oscillator, c.lfo);
+        case SynthCommand::Type::setTremolo:
+            return modulator_.setTremolo(c.oscillator, c.lfo);
+        case SynthCommand::Type::setControlRate:
+            return modulator_.setRate(c.controlRate);
+        case SynthCommand::Type::setParameters:
+            return applyParameters(c.parameters);
+    }
+}
+
+// Write a whole set of parameters straight to the registers. Unlike
+// applying each setting on its own, the voices are only reconfigured
+// once.
+void Synth::applyParameters(const SynthParameters& p)
+{
+    // the chips which are going away won't be updated anymore
+    silence(p.chips);
+    if (p.policy != policy_) {
+        silence(0);
+        policy_ = p.policy;
+        for (int i = 0; i < NUM_OSC; i++) {
+            channelVoices_[i].reset();
+        }
+    }
+    for (int i = numChips_; i < p.chips; i++) {
+        modulate(i);
+    }
+    numChips_ = p.chips;
+    std::memcpy(configs_, p.configs, sizeof(configs_));
+    for (int i = 0; i < MAX_CHIPS; i++) {
+        Chip& chip = chips_[i];
+        chip.osc1.setDuty(p.duty[0]);
+        chip.osc2.setDuty(p.duty[1]);
+        for (OSCID o = 0; o < NUM_OSC; o++) {
+            chip.oscs[o]->volume = p.volume[o];
+        }
+        chip.osc3.setWaveTable(p.wavetable);
+        chip.apu.setQuality(p.quality);
+    }
+    for (OSCID o = 0; o < NUM_OSC; o++) {
+        modulator_.setVibrato(o, p.vibrato[o]);
+        modulator_.setTremolo(o, p.tremolo[o]);
+    }
+    modulator_.setRate(p.controlRate);
+    reconfigure(0);
+}
+
+// silence the chips from firstChip on
+void Synth::silence(int firstChip)
+{
+    MidiEvent off = { 0, 0 };
+    for (int c = firstChip; c < numChips_; c++) {
+        for (OSCID o = 0; o < NUM_OSC; o++) {
+            if (configs_[o].enabled) sendEvent(c, o, off);
+        }
+    }
+}
+
+// the registers no longer match sent_, so every event must be written again
+void Synth::forgetSent()
+{
+    MidiEvent unknown = { 0xFF, 0xFF };
+    for (int c = 0; c < MAX_CHIPS; c++) {
+        for (OSCID o = 0; o < NUM_OSC; o++) {
+            sent_[c][o] = unknown;
+        }
+    }
+}
+
+void Synth::sendEvent(int chip, OSCID oscillator, MidiEvent event)
+{
+    MidiEvent& sent = sent_[chip][oscillator];
+    if (sent.note == event.note && sent.velocity == event.velocity) return;
+    sent = event;
+    chips_[chip].oscs[oscillator]->setEvent(event);
+}
+
+// pass the state of a channel's manager to the oscillators on that
+// channel. Only the ones whose note changed are written to.
+template <typename Manager>
+void Synth::sendEvents(Manager& manager, int index)
+{
+    uint8_t voicesPerChip = channelVoices_[index].voicesPerChip;
+    for (int c = 0; c < numChips_; c++) {
+        for (OSCID i = 0; i < NUM_OSC; i++) {
+            if (!configs_[i].enabled || channelIndex_[configs_[i].channel] != index) continue;
+            MidiEvent e = manager.get(c * voicesPerChip + voiceSlots_[i]);
+            e.note += configs_[i].transpose;
+            sendEvent(c, i, e);
+        }
+    }
+}
+
+void Synth::sendEvents()
+{
+    for (int index = 0; index < NUM_OSC; index++) {
+        ChannelVoices& voices = channelVoices_[index];
+        if (voices.channel < 0) continue;
+        switch (policy_) {
+            case VoicePolicy::leastRecentlyUsed: sendEvents(voices.lru, index); break;
+            case VoicePolicy::lowestNote: sendEvents(voices.lowest, index); break;
+            case VoicePolicy::highestNote: sendEvents(voices.highest, index); break;
+            case VoicePolicy::roundRobin: sendEvents(voices.roundRobin, index); break;
+            case VoicePolicy::noSteal: sendEvents(voices.noSteal, index); break;
+        }
+    }
 }
 
 void Synth::reconfigure(OSCID oscillator)
 {
-    // TODO: allow changing settings without resetting all keys
-    uint8_t voices = 0;
-    size_t voicesRequired = 0;
+    // only what actually changed is written, and held keys keep
+    // playing: the managers keep their notes when the number of
+    // voices changes
     uint8_t enabled = 0;
+    int8_t channelIndex[16];
+    for (int ch = 0; ch < 16; ch++) {
+        channelIndex[ch] = -1;
+    }
     for (OSCID i = 0; i < NUM_OSC; i++) {
-        if (!configs_[i].enabled) continue;
-        enabled |= (1 << i);
-        if ((voices >> configs_[i].voice) & 0x01) {
-            continue;
+        if (configs_[i].enabled) enabled |= (1 << i);
+    }
+    // channels which are still in use keep their voices
+    for (int index = 0; index < NUM_OSC; index++) {
+        int8_t channel = channelVoices_[index].channel;
+        if (channel < 0) continue;
+        bool used = false;
+        for (OSCID i = 0; i < NUM_OSC; i++) {
+            used |= configs_[i].enabled && configs_[i].channel == channel;
+        }
+        if (used) {
+            channelIndex[channel] = (int8_t) index;
+        } else {
+            channelVoices_[index].channel = -1;
+        }
+    }
+    // new channels start from no keys held
+    for (OSCID i = 0; i < NUM_OSC; i++) {
+        uint8_t channel = configs_[i].channel;
+        if (!configs_[i].enabled || channelIndex[channel] >= 0) continue;
+        int index = 0;
+        while (channelVoices_[index].channel >= 0) index++;
+        channelVoices_[index].channel = (int8_t) channel;
+        channelVoices_[index].reset();
+        channelIndex[channel] = (int8_t) index;
+    }
+    std::memcpy(channelIndex_, channelIndex, sizeof(channelIndex_));
+
+    for (int index = 0; index < NUM_OSC; index++) {
+        ChannelVoices& voices = channelVoices_[index];
+        if (voices.channel < 0) continue;
+        uint8_t used = 0;
+        for (OSCID i = 0; i < NUM_OSC; i++) {
+            if (configs_[i].enabled && configs_[i].channel == voices.channel) {
+                used |= (1 << configs_[i].voice);
+            }
+        }
+        // pack the voices in use together, so e.g. voices 1 and 3
+        // become the first and second voice of each chip
+        uint8_t slots[NUM_OSC];
+        uint8_t voicesRequired = 0;
+        for (uint8_t v = 0; v < NUM_OSC; v++) {
+            slots[v] = voicesRequired;
+            if ((used >> v) & 0x01) voicesRequired++;
+        }
+        for (OSCID i = 0; i < NUM_OSC; i++) {
+            if (configs_[i].channel == voices.channel) voiceSlots_[i] = slots[configs_[i].voice];
         }
-        voices |= (1 << configs_[i].voice);
-        voicesRequired++;
+        voices.voicesPerChip = voicesRequired;
+        voices.setVoices(voicesRequired * numChips_);
+    }
+    enabled_ = enabled;
+    updateMixer();
+    sendEvents();
+}
+
+void Synth::updateMixer()
+{
+    if (mixer_ == enabled_) return;
+    mixer_ = enabled_;
+    for (int c = 0; c < MAX_CHIPS; c++) {
+        // TODO: support stereo assignment
+        chips_[c].apu.writeRegister(NR50, 0x7F);
+        chips_[c].apu.writeRegister(NR51, (enabled_ << 4) | enabled_); // enable voices
     }
-    manager_.setVoices(voicesRequired);
-    // TODO: support stereo assignment
-    apu_.writeRegister(NR50, 0x7F);
-    apu_.writeRegister(NR51, (enabled << 4) | enabled); // enable voices
 }
 
 void Synth::handleMIDI(juce::MidiBuffer& midiMessages)
 {
+    // events are sorted by time, so the writes for each one are
+    // scheduled at the exact clock its sample offset corresponds to
     for (const juce::MidiMessageMetadata metadata : midiMessages) {
-        handleMIDIEvent(metadata.getMessage());
+        modulateUntil(metadata.samplePosition);
+        handleMIDIEvent(metadata.getMessage(), metadata.samplePosition);
+    }
+}
+
+// Write the modulation for each control tick before samplePosition in
+// the current block, in time with the MIDI events around it
+void Synth::modulateUntil(int samplePosition)
+{
+    int tick;
+    while (modulator_.nextTick(samplePosition, tick)) {
+        for (int c = 0; c < numChips_; c++) {
+            chips_[c].apu.setSampleTime(tick);
+            modulate(c);
+        }
+    }
+}
+
+// bring a chip's oscillators up to the last tick's modulation
+void Synth::modulate(int chip)
+{
+    for (OSCID i = 0; i < NUM_OSC; i++) {
+        chips_[chip].oscs[i]->modulate(modulator_.pitch(i), modulator_.level(i));
     }
 }
 
 void Synth::readSamples(juce::AudioBuffer<float> *out)
 {
-    apu_.readSamples(out);
+    int numSamples = out->getNumSamples();
+    // the rest of the block's ticks, then it's over as far as the
+    // LFOs are concerned
+    modulateUntil(numSamples);
+    modulator_.endBlock(numSamples);
+    if (numChips_ == 1) {
+        // the buffers are sized for the block size the host promised
+        for (int start = 0; start < numSamples; start += maxBlockSize_) {
+            chips_[0].apu.readSamples(out, start, std::min(maxBlockSize_, numSamples - start));
+        }
+        return;
+    }
+    // render each chip into its own buffer in parallel, then mix them
+    for (int start = 0; start < numSamples; start += maxBlockSize_) {
+        int count = std::min(maxBlockSize_, numSamples - start);
+        renderCount_ = count;
+        pool_.run(numChips_, &Synth::renderChip, this);
+        for (int c = 0; c < numChips_; c++) {
+            for (int ch = 0; ch < out->getNumChannels(); ch++) {
+                out->addFrom(ch, start, chipBuffers_[c], ch, 0, count);
+            }
+        }
+    }
+}
+
+void Synth::renderChip(void* context, int chip)
+{
+    Synth* synth = (Synth*) context;
+    synth->chips_[chip].apu.readSamples(&synth->chipBuffers_[chip], 0, synth->renderCount_);
 }
 
-void Synth::handleMIDIEvent(juce::MidiMessage msg)
+void Synth::handleMIDIEvent(juce::MidiMessage msg, int samplePosition)
 {
     if (msg.isSysEx()) return;
-
-    if (manager_.voices() == 0) return;
     // https://www.midi.org/specifications-old/item/table-1-summary-of-midi-message
-    // TODO: use time of msg
+    if (!msg.isNoteOn() && !msg.isNoteOff()) return;
+
+    int index = channelIndex_[msg.getChannel() - 1];
+    if (index < 0) return; // no oscillators on this channel
+    ChannelVoices& voices = channelVoices_[index];
+    switch (policy_) {
+        case VoicePolicy::leastRecentlyUsed: return handleMIDIEvent(voices.lru, index, msg, samplePosition);
+        case VoicePolicy::lowestNote: return handleMIDIEvent(voices.lowest, index, msg, samplePosition);
+        case VoicePolicy::highestNote: return handleMIDIEvent(voices.highest, index, msg, samplePosition);
+        case VoicePolicy::roundRobin: return handleMIDIEvent(voices.roundRobin, index, msg, samplePosition);
+        case VoicePolicy::noSteal: return handleMIDIEvent(voices.noSteal, index, msg, samplePosition);
+    }
+}
+
+template <typename Manager>
+void Synth::handleMIDIEvent(Manager& manager, int index, juce::MidiMessage msg, int samplePosition)
+{
+    if (manager.voices() == 0) return;
     if (msg.isNoteOn()) {
-        manager_.handle(msg.getNoteNumber(), msg.getVelocity());
-    } else if (msg.isNoteOff()) {
-        manager_.handle(msg.getNoteNumber(), 0);
+        manager.handle(msg.getNoteNumber(), msg.getVelocity());
     } else {
-        return;
+        manager.handle(msg.getNoteNumber(), 0);
     }
     // now pass that midi info to the oscillators
-    for (OSCID i = 0; i < NUM_OSC; i++) {
-        if (!configs_[i].enabled) continue;
-        MidiEvent e = manager_.get(configs_[i].voice);
-        e.note += configs_[i].transpose;
-        oscs_[i]->setEvent(e);
+    for (int c = 0; c < numChips_; c++) {
+        chips_[c].apu.setSampleTime(samplePosition);
     }
+    sendEvents(manager, index);
 }
@@ -12,6 +12,9 @@
 
 #include <JuceHeader.h>
 #include "midimanager/midimanager.h"
+#include "CommandQueue.h"
+#include "RenderPool.h"
+#include "VgmRecorder.h"
 #include "Gb_Snd_Emu-0.1.4-patched/gb_apu/Gb_Apu.h"
 #include "Gb_Snd_Emu-0.1.4-patched/gb_apu/Multi_Buffer.h"
 
@@ -22,6 +25,9 @@ static const gb_time_t CLOCKS_PER_INSTRUCTION = 4;
 typedef uint8_t OSCID;
 static const OSCID NUM_OSC = 4;
 
+// In polyphonic mode several emulated Game Boys are run side by side
+static const int MAX_CHIPS = 16;
+
 static const uint16_t Sq1Addr = 0xFF10; // Square 1 (with freq envelope)
 static const uint16_t Sq2Addr = 0xFF15; // Square 2
 static const uint16_t WaveAddr = 0xFF1A; // Wave
@@ -107,6 +113,38 @@ struct MidiConfig {
     int8_t transpose;
 };
 
+// How held keys are assigned to voices when there are more of
+// them than voices. See midimanager/policies.h
+enum class VoicePolicy: uint8_t
+{
+    leastRecentlyUsed, lowestNote, highestNote, roundRobin, noSteal
+};
+
+// How band-limited the oscillators are. Lower levels take less CPU, e.g.
+// for playing live with small buffers, and higher ones alias less, e.g.
+// for offline renders. standard is the emulator's own mix of good for the
+// squares and medium for the wave and noise.
+enum class SynthQuality: uint8_t
+{
+    standard, low, medium, good, high
+};
+
+// How often the LFOs are stepped and written to the registers. The hz
+// rates are steps of the Game Boy's own frame sequencer; the others are
+// note lengths at the host's tempo, which quantizes the modulation.
+enum class ControlRate: uint8_t
+{
+    hz64, hz128, hz256, sixteenths, thirtySeconds, sixtyFourths
+};
+
+// A low frequency oscillator, at rate cycles per second. A depth of 0
+// turns it off.
+struct LfoSettings
+{
+    float rate;
+    float depth;
+};
+
 enum class DutyCycle: uint8_t
 {
     duty12_5 = 0x00, duty25 = 0x01, duty50 = 0x02, duty75 = 0x03
@@ -119,32 +157,79 @@ enum GBWaveVolume: uint8_t
     WAVE_VOL_OFF = 0x00, WAVE_VOL_FULL = 0x01, WAVE_VOL_50 = 0x02, WAVE_VOL_25 = 0x03
 };
 
+struct RegisterWrite {
+    blip_time_t time;
+    gb_addr_t addr;
+    uint8_t data;
+};
+
 class Apu
 {
 private:
+    static const int MAX_PENDING_WRITES = 256;
+
     Gb_Apu apu_;
+    // only the one for the configured channel count has any memory
     Stereo_Buffer sbuf_;
     Mono_Buffer mbuf_;
     Multi_Buffer* buf_;
+    // the buffers' memory, unless the owner provides it
+    juce::HeapBlock<Blip_Buffer::buf_t_> memory_;
     bool stereo_;
     blip_time_t clock_;
-    blip_sample_t samples_[2];
+    long maxSamples_;
+    // Writes are timestamped and held until the frame is rendered, so
+    // that all the emulation work happens in readSamples (which may be
+    // on a worker thread)
+    RegisterWrite pending_[MAX_PENDING_WRITES];
+    int numPending_;
+    // clocks since the APU started, up to the start of this frame
+    int64_t frameStart_;
+    // the last value written to each register
+    uint8_t registers_[Gb_Apu::register_count];
+    VgmRecorder* recorder_;
+    int recordedSession_;
 
 public:
     Apu();
     ~Apu();
 
-    void configure(double sampleRate, int channels);
+    // The buffers hold a little more than samplesPerBlock, which is the
+    // most readSamples() renders at once. They're kept in memory, which
+    // must hold memorySize() elements, or allocated if it's null.
+    void configure(double sampleRate, int channels, int samplesPerBlock, Blip_Buffer::buf_t_* memory = nullptr);
+    static long memorySize(double sampleRate, int channels, int samplesPerBlock);
+    // schedule the following register writes at a sample offset into the current block
+    void setSampleTime(long samplePosition);
     void writeRegister(gb_addr_t addr, uint8_t data);
+    // write at an exact clock from the start of the current frame instead
+    void writeRegisterAt(blip_time_t time, gb_addr_t addr, uint8_t data);
     uint8_t readRegister(gb_addr_t addr);
+    // clocks since the APU started, up to the start of the current frame
+    int64_t frameStart() const { return frameStart_; }
+    // clocks from the start of the current frame until sampleCount
+    // samples can be read
+    blip_time_t clocksUntil(long sampleCount) { return center()->count_clocks(sampleCount); }
 
     long samplesAvailable();
-    void readSamples(juce::AudioBuffer<float>* out);
+    void readSamples(juce::AudioBuffer<float>* out, int startSample, int numSamples);
+    // samples from a write to its effect on the output, whatever the quality
+    int latencySamples() { return center()->output_latency(); }
 
     void reset();
+    // can be changed between blocks without any glitch
+    void setQuality(SynthQuality quality);
+    // send every register write to recorder, while it's recording
+    void setRecorder(VgmRecorder* recorder) { recorder_ = recorder; }
 
 private:
     blip_time_t tick() { return clock_ += 4; }
+    void queueWrite(blip_time_t time, gb_addr_t addr, uint8_t data);
+    void flushWrites();
+    void record();
+    Blip_Buffer* center() { return stereo_ ? sbuf_.center() : mbuf_.center(); }
+    static int bufferLength(double sampleRate, int samplesPerBlock);
+    void endFrame(long sampleCount);
 };
 
 class Oscillator {
@@ -167,17 +252,39 @@ public:
     void setApu(Apu* apu)
     {
         apu_ = apu;
+        // the registers may have been reset
+        period_ = -1;
+        volumeRegister_ = -1;
+        note_ = 0;
+        velocity_ = 0;
         afterInit();
     }
     virtual void setEvent(MidiEvent event) = 0;
+    // Bend the note playing to pitch times its frequency and scale its
+    // volume by level. Only the registers whose value changes are
+    // written; later notes start out modulated too. The pitch is bent
+    // without retriggering the note, but a new volume is only picked up
+    // by the envelope channels when they're triggered.
+    void modulate(double pitch, float level);
 
     float volume = 1.0;
 
 private:
-    uint16_t midiNoteToPeriod(uint8_t note);
-    uint8_t midiVelocityTo4BitVolume(uint8_t velocity);
+    uint16_t midiNoteToPeriod(uint8_t note) const;
+    // what was last written to the period and volume registers, or -1
+    int period_ = -1;
+    int volumeRegister_ = -1;
 
 protected:
+    // the note playing, which is silent if velocity_ is 0
+    uint8_t note_ = 0;
+    uint8_t velocity_ = 0;
+    double pitch_ = 1.0;
+    float level_ = 1.0f;
+
+    static uint8_t midiVelocityTo4BitVolume(uint8_t velocity);
+    uint8_t scaledVolume(uint8_t velocity) const;
+
     // NRX3 and lower NRX4, Osc 1,2,3 only
     void set11BitPeriod(uint8_t note);
 
@@ -185,6 +292,9 @@ protected:
     // Note: if you want to trigger the envelope, you must set it before NRX3
     void setVolumeEnvelope(uint8_t startVelocity, bool increasing, uint8_t period);
     void setConstantVolume(uint8_t velocity);
+    void writeVolume(uint8_t data);
+    // NRX2 for the note playing at level_
+    virtual uint8_t volumeRegister() const;
 };
 
 class SquareOscilator: public Oscillator
@@ -213,15 +323,20 @@ public:
         }
     }
 
-    static double normalizeDutyCycle(double value)
+    static double valueFromDutyCycle(DutyCycle duty)
     {
-        DutyCycle d = dutyCycleFromValue(value);
-        switch (d) {
+        switch (duty) {
             case DutyCycle::duty12_5: return 12.5;
             case DutyCycle::duty25: return 25.0;
             case DutyCycle::duty50: return 50.0;
             case DutyCycle::duty75: return 75.0;
         }
+        return 50.0;
+    }
+
+    static double normalizeDutyCycle(double value)
+    {
+        return valueFromDutyCycle(dutyCycleFromValue(value));
     }
 
 protected:
@@ -245,16 +360,23 @@ public:
 
 class WaveOscillator : public Oscillator
 {
+private:
+    uint8_t wavetable_[WAVE_TABLE_SIZE];
+
 public:
-    WaveOscillator(): Oscillator(2) {}
+    WaveOscillator(): Oscillator(2)
+    {
+        std::memcpy(wavetable_, WAVE_TABLE_SINE, WAVE_TABLE_SIZE);
+    }
     ~WaveOscillator() {}
     void setEvent(MidiEvent event);
-    void setWaveTable(uint8_t* samples);
+    void setWaveTable(const uint8_t* samples);
 
 protected:
     void afterInit();
+    uint8_t volumeRegister() const;
 private:
-    GBWaveVolume midiVelocityToWaveVolume(uint8_t velocity);
+    static GBWaveVolume midiVelocityToWaveVolume(uint8_t velocity);
     void setVelocity(uint8_t velocity);
 };
 
@@ -269,67 +391,252 @@ protected:
     void afterInit();
 };
 
-// Track MIDI state, which is separate from the register settings,
-// and convert MIDI events into register calls
-// TODO: this guy can also be a FIFO queue for changes from the UI
-class Synth
+// Steps the LFOs at the control rate. Each tick works out every
+// oscillator's pitch and level once, which all the chips then write.
+class Modulator
 {
 private:
-    // since there are only 4 oscillators, we won't need more than
-    // 4 channels, so we pre-allocate all of them.
-    // TODO: support channels
-//    MidiManager<16, NUM_OSC> managers_[NUM_OSC];
-//    uint channels_[NUM_OSC]; // key = manager index, value = channel id
-    MidiConfig configs_[NUM_OSC];
-    MidiManager<16, 4> manager_;
-    Apu apu_;
+    LfoSettings vibrato_[NUM_OSC];
+    LfoSettings tremolo_[NUM_OSC];
+    ControlRate rate_;
+    double sampleRate_;
+    double tempo_;
+    double samplesPerTick_;
+    // from the start of the current block to the next tick, in samples
+    double nextTick_;
+    // in cycles
+    double vibratoPhase_[NUM_OSC];
+    double tremoloPhase_[NUM_OSC];
+    // as of the last tick
+    double pitch_[NUM_OSC];
+    float level_[NUM_OSC];
+
+public:
+    Modulator();
+
+    void configure(double sampleRate);
+    void setRate(ControlRate rate);
+    // in beats per minute, for the rates which follow the tempo
+    void setTempo(double bpm);
+    // depth in semitones either way
+    void setVibrato(OSCID oscillator, LfoSettings lfo) { vibrato_[oscillator] = lfo; }
+    // depth as the fraction of the volume taken away at the bottom
+    void setTremolo(OSCID oscillator, LfoSettings lfo) { tremolo_[oscillator] = lfo; }
+
+    // If there's a tick before samplePosition in the current block, step
+    // the LFOs to it and return true with its position in tickPosition
+    bool nextTick(int samplePosition, int& tickPosition);
+    // the next block starts numSamples after the current one
+    void endBlock(int numSamples) { nextTick_ -= numSamples; }
+    // frequency multiplier
+    double pitch(OSCID oscillator) const { return pitch_[oscillator]; }
+    // volume multiplier
+    float level(OSCID oscillator) const { return level_[oscillator]; }
+
+private:
+    void updateTickLength();
+};
+
+// Every setting of the Synth, i.e. everything which is saved with
+// the plugin's state
+struct SynthParameters
+{
+    MidiConfig configs[NUM_OSC];
+    DutyCycle duty[2]; // square oscillators only
+    float volume[NUM_OSC];
+    uint8_t wavetable[WAVE_TABLE_SIZE];
+    uint8_t chips;
+    VoicePolicy policy;
+    SynthQuality quality;
+    LfoSettings vibrato[NUM_OSC];
+    LfoSettings tremolo[NUM_OSC];
+    ControlRate controlRate;
+};
+
+// A parameter change requested from the UI, applied on the audio thread
+struct SynthCommand
+{
+    enum class Type: uint8_t
+    {
+        setEnabled, setTranspose, setMIDIVoice, setMIDIChannel,
+        setDutyCycle, setVolume, setWaveTable, setChipCount,
+        setVoicePolicy, setQuality, setVibrato, setTremolo,
+        setControlRate, setParameters
+    };
+
+    Type type;
+    OSCID oscillator;
+    union {
+        bool enabled;
+        int8_t transpose;
+        uint8_t voice;
+        uint8_t channel;
+        uint8_t chips;
+        VoicePolicy policy;
+        SynthQuality quality;
+        LfoSettings lfo;
+        ControlRate controlRate;
+        double value;
+        uint8_t wavetable[WAVE_TABLE_SIZE];
+        SynthParameters parameters;
+    };
+};
+
+// One emulated Game Boy: an APU and the oscillators which drive it
+struct Chip
+{
+    Apu apu;
     SquareOscilatorOne osc1;
     SquareOscilatorTwo osc2;
     WaveOscillator osc3;
     NoiseOscillator osc4;
-    Oscillator* oscs_[NUM_OSC] = { &osc1, &osc2, &osc3, &osc4 };
+    Oscillator* oscs[NUM_OSC] = { &osc1, &osc2, &osc3, &osc4 };
+
+    Chip()
+    {
+        for (OSCID i = 0; i < NUM_OSC; i++) {
+            oscs[i]->setApu(&apu);
+        }
+    }
+};
+
+// The keys held on one MIDI channel. There's a MidiManager for each
+// VoicePolicy so that the allocation code is resolved at compile
+// time; only the one for the Synth's current policy is used.
+struct ChannelVoices
+{
+    MidiManager<16, NUM_OSC * MAX_CHIPS, LruPolicy> lru;
+    MidiManager<16, NUM_OSC * MAX_CHIPS, LowestNotePolicy> lowest;
+    MidiManager<16, NUM_OSC * MAX_CHIPS, HighestNotePolicy> highest;
+    MidiManager<16, NUM_OSC * MAX_CHIPS, RoundRobinPolicy> roundRobin;
+    MidiManager<16, NUM_OSC * MAX_CHIPS, NoStealPolicy> noSteal;
+    // the MIDI channel these are for, or -1 if unused
+    int8_t channel = -1;
+    // number of distinct MidiConfig voices on this channel
+    uint8_t voicesPerChip = 0;
+
+    void reset();
+    void setVoices(size_t voices);
+};
+
+// Track MIDI state, which is separate from the register settings,
+// and convert MIDI events into register calls.
+// The public setters are safe to call from the message thread: they
+// only queue the change, which is applied by processCommands() on
+// the audio thread.
+// The Synth also keeps a copy of every setting on the message thread
+// side, which is what the editor starts from and what is saved.
+// Each oscillator follows the keys on its own MIDI channel, and the
+// oscillators on the same channel share its voices.
+// Normally a single chip is used, i.e. at most 4 notes at once. In
+// polyphonic mode each additional chip adds another copy of every
+// enabled voice, and the chips are rendered in parallel.
+class Synth
+{
+private:
+    MidiConfig configs_[NUM_OSC];
+    VoicePolicy policy_;
+    // the settings as last requested, only used by the message thread
+    SynthParameters parameters_;
+    // since there are only 4 oscillators, we won't need more than
+    // 4 channels, so we pre-allocate all of them.
+    ChannelVoices channelVoices_[NUM_OSC];
+    // key = MIDI channel, value = index into channelVoices_, or -1
+    int8_t channelIndex_[16];
+    // key = oscillator, value = index of its MidiConfig voice among
+    // its channel's voices on each chip
+    uint8_t voiceSlots_[NUM_OSC];
+    Chip chips_[MAX_CHIPS];
+    int numChips_;
+    // the event each oscillator was last given, so that the ones
+    // which haven't changed aren't written (and retriggered) again
+    MidiEvent sent_[MAX_CHIPS][NUM_OSC];
+    // bit mask of the enabled oscillators, and the mask NR51 was
+    // last written with (-1 if it needs writing)
+    uint8_t enabled_;
+    int mixer_;
+    juce::AudioBuffer<float> chipBuffers_[MAX_CHIPS];
+    int maxBlockSize_;
+    int renderCount_;
+    // every chip's buffers, one after another
+    juce::HeapBlock<Blip_Buffer::buf_t_> buffers_;
+    long buffersSize_;
+    RenderPool pool_;
+    CommandQueue<SynthCommand, 256> commands_;
+    // if the queue fills up, e.g. while the host isn't processing, the
+    // latest settings are handed over whole instead. resync_ is set while
+    // resyncParameters_ is waiting for the audio thread
+    SynthParameters resyncParameters_;
+    juce::SpinLock resyncLock_;
+    std::atomic<bool> resync_;
+    VgmRecorder recorder_;
+    Modulator modulator_;
 
 public:
     Synth();
 
-    static Synth INSTANCE;
-
-    void configure(double sampleRate, int channels);
+    void configure(double sampleRate, int channels, int samplesPerBlock);
 
     void setEnabled(OSCID oscillator, bool enabled);
     void setTranspose(OSCID oscillator, int8_t transpose);
     void setMIDIVoice(OSCID oscillator, uint8_t voice);
     void setMIDIChannel(OSCID oscillator, uint8_t channel);
-
-    void setDutyCycle(OSCID oscillator, double value)
-    {
-        DutyCycle duty = SquareOscilator::dutyCycleFromValue(value);
-        switch (oscillator)
-        {
-            case 0: return osc1.setDuty(duty);
-            case 1: return osc2.setDuty(duty);
-            default: return;
-        }
-    }
-
-    void setVolume(OSCID oscillator, double value)
-    {
-        jassert(value >= 0.0 && value <= 1.0);
-        oscs_[oscillator]->volume = value;
-    }
-
-    void setWaveTable(uint8_t* samples)
-    {
-        osc3.setWaveTable(samples);
-    }
-
+    void setDutyCycle(OSCID oscillator, double value);
+    void setVolume(OSCID oscillator, double value);
+    void setWaveTable(const uint8_t* samples);
+    // Number of chips to run, 1 for the normal 4-voice mode
+    void setChipCount(int chips);
+    void setVoicePolicy(VoicePolicy policy);
+    void setQuality(SynthQuality quality);
+    void setVibrato(OSCID oscillator, LfoSettings lfo);
+    void setTremolo(OSCID oscillator, LfoSettings lfo);
+    void setControlRate(ControlRate rate);
+    // the host's tempo, for the control rates which follow it. Call from
+    // the audio thread before handling MIDI
+    void setTempo(double bpm) { modulator_.setTempo(bpm); }
+
+    const SynthParameters& getParameters() const { return parameters_; }
+    // replace every setting at once
+    void setParameters(const SynthParameters& parameters);
+    // a compact binary copy of the settings, for the plugin state
+    void saveState(juce::MemoryBlock& destData) const;
+    // returns false (and changes nothing) if data isn't a saved state
+    bool loadState(const void* data, int sizeInBytes);
+
+    // Record the first chip's register writes to a VGM file, e.g. to
+    // play a performance back on hardware. The other chips in
+    // polyphonic mode aren't recorded.
+    bool startRecording(const juce::File& file) { return recorder_.start(file); }
+    void stopRecording() { recorder_.stop(); }
+    bool isRecording() const { return recorder_.isRecording(); }
+
+    // apply any changes queued by the setters. Call from the audio thread
+    // before handling MIDI
+    void processCommands();
     void handleMIDI(juce::MidiBuffer& midiMessages);
     void readSamples(juce::AudioBuffer<float>* out);
+    // how far the output lags behind the MIDI, for the host to compensate
+    int getLatencySamples() { return chips_[0].apu.latencySamples(); }
 
     void setDefaults();
     void stop();
 
 private:
+    void post(const SynthCommand& command);
+    void apply(const SynthCommand& command);
+    void applyParameters(const SynthParameters& parameters);
     void reconfigure(OSCID oscillator);
-    void handleMIDIEvent(juce::MidiMessage msg);
+    void updateMixer();
+    void silence(int firstChip);
+    void forgetSent();
+    void sendEvent(int chip, OSCID oscillator, MidiEvent event);
+    void sendEvents();
+    template <typename Manager>
+    void sendEvents(Manager& manager, int index);
+    void handleMIDIEvent(juce::MidiMessage msg, int samplePosition);
+    void modulateUntil(int samplePosition);
+    void modulate(int chip);
+    template <typename Manager>
+    void handleMIDIEvent(Manager& manager, int index, juce::MidiMessage msg, int samplePosition);
+    static void renderChip(void* synth, int chip);
 };
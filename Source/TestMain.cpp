@@ -0,0 +1,26 @@
+/*
+  ==============================================================================
+
+    TestMain.cpp
+    Created: 17 Oct 2026 9:26:05pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "Tests.h"
+
+int main(int argc, char* argv[])
+{
+    juce::ArgumentList args(argc, argv);
+    juce::int64 seed = 1;
+    if (args.containsOption("--seed")) seed = args.getValueForOption("--seed").getLargeIntValue();
+    juce::Random random(seed);
+    std::cerr << "Random seed " << seed << std::endl;
+
+    bool ok = true;
+    ok &= runBlipSynthTests(random);
+    ok &= runVgmPlayerTests();
+    return ok ? 0 : 1;
+}
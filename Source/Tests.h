@@ -0,0 +1,18 @@
+/*
+  ==============================================================================
+
+    Tests.h
+    Created: 17 Oct 2026 9:26:05pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// The checks GameBoySynthTest runs. Each prints what it checked and
+// returns false if anything was wrong.
+bool runBlipSynthTests(juce::Random& random);
+bool runVgmPlayerTests();
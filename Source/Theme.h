@@ -13,6 +13,7 @@
 #include <JuceHeader.h>
 
 static const int KeyboardHeight = 64;
+static const int ChipPickerWidth = 64;
 static const int WindowWidth = 800;
 static const int WindowHeight = 600;
 static const int OscBoxWidth = WindowWidth / 2;
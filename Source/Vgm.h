@@ -0,0 +1,59 @@
+/*
+  ==============================================================================
+
+    Vgm.h
+    Created: 17 Oct 2026 5:02:48pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Gb_Snd_Emu-0.1.4-patched/gb_apu/Gb_Apu.h"
+
+// The parts of the VGM format which VgmRecorder writes and VgmPlayer
+// reads. VGM 1.61 is the first version with the Game Boy. Times in a
+// VGM file are counted in samples at 44.1kHz, whatever the player's
+// rate is.
+// https://vgmrips.net/wiki/VGM_Specification
+
+static const int VGM_VERSION = 0x161;
+static const int VGM_HEADER_SIZE = 0x100;
+static const int64_t VGM_SAMPLE_RATE = 44100;
+static const int VGM_DMG_CLOCK = 4194304;
+
+// where the header fields are. The offsets stored in the header are
+// relative to where they're stored.
+static const int VGM_EOF_OFFSET = 0x04;
+static const int VGM_VERSION_OFFSET = 0x08;
+static const int VGM_TOTAL_SAMPLES = 0x18;
+static const int VGM_LOOP_OFFSET = 0x1C;
+static const int VGM_LOOP_SAMPLES = 0x20;
+static const int VGM_DATA_OFFSET = 0x34;
+static const int VGM_DMG_CLOCK_OFFSET = 0x80;
+
+static const uint8_t VGM_WAIT = 0x61; // followed by a 16-bit sample count
+static const uint8_t VGM_WAIT_60HZ = 0x62; // 735 samples
+static const uint8_t VGM_WAIT_50HZ = 0x63; // 882 samples
+static const uint8_t VGM_END = 0x66;
+static const uint8_t VGM_DATA_BLOCK = 0x67;
+static const uint8_t VGM_WAIT_SHORT = 0x70; // plus (samples - 1), up to 16
+static const uint8_t VGM_DMG_WRITE = 0xB3; // followed by register, data
+
+// Call write(addr) for every APU register in an order which recreates
+// the sound from a copy of the registers: power first, then the mixer
+// and wave RAM, then each oscillator with its trigger register last.
+template <typename Write>
+void forEachRegisterToRestore(Write write)
+{
+    static const gb_addr_t power = 0xFF26;
+    static const gb_addr_t lastOscillator = 0xFF23;
+    write(power);
+    for (gb_addr_t addr = lastOscillator + 1; addr <= Gb_Apu::end_addr; addr++) {
+        if (addr != power) write(addr);
+    }
+    for (gb_addr_t addr = Gb_Apu::start_addr; addr <= lastOscillator; addr++) {
+        write(addr);
+    }
+}
@@ -0,0 +1,294 @@
+/*
+  ==============================================================================
+
+    VgmPlayer.cpp
+    Created: 17 Oct 2026 5:02:48pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#include "VgmPlayer.h"
+#include "Vgm.h"
+
+static uint32_t read32(const uint8_t* data, size_t offset)
+{
+    return juce::ByteOrder::littleEndianInt(data + offset);
+}
+
+// the size of a command including its operands, for the commands of
+// every chip, so that the ones for other chips can be skipped.
+// 0 if it's unknown (data blocks are handled separately).
+static size_t commandSize(uint8_t command)
+{
+    if (command >= 0x30 && command <= 0x3F) return 2;
+    if (command >= 0x40 && command <= 0x4E) return 3;
+    if (command == 0x4F || command == 0x50) return 2;
+    if (command >= 0x51 && command <= 0x5F) return 3;
+    if (command == VGM_WAIT) return 3;
+    if (command == VGM_WAIT_60HZ || command == VGM_WAIT_50HZ || command == VGM_END) return 1;
+    if (command == 0x64) return 4;
+    if (command == 0x68) return 12;
+    if (command >= 0x70 && command <= 0x8F) return 1;
+    if (command == 0x90 || command == 0x91 || command == 0x95) return 5;
+    if (command == 0x92) return 6;
+    if (command == 0x93) return 11;
+    if (command == 0x94) return 2;
+    if (command >= 0xA0 && command <= 0xBF) return 3;
+    if (command >= 0xC0 && command <= 0xDF) return 4;
+    if (command >= 0xE0) return 5;
+    return 0;
+}
+
+VgmPlayer::VgmPlayer()
+{
+    changed_ = false;
+    sampleRate_ = 0;
+    maxBlockSize_ = 0;
+    std::memset(&cursor_, 0, sizeof(cursor_));
+    cursor_.finished = true;
+    cursor_.loopedAt = -1;
+    originSample_ = 0;
+    originClock_ = 0;
+    nextPosition_ = -1;
+}
+
+juce::String VgmPlayer::load(const juce::File& file)
+{
+    auto song = std::make_unique<Song>();
+    song->file = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+    const uint8_t* d = (const uint8_t*) song->file->getData();
+    size_t size = song->file->getSize();
+    if (d == nullptr) return "Couldn't read " + file.getFullPathName();
+    if (size >= 2 && d[0] == 0x1F && d[1] == 0x8B) {
+        return file.getFileName() + " is compressed, only uncompressed VGM files can be played";
+    }
+    if (size < 0x40 || std::memcmp(d, "Vgm ", 4) != 0) return file.getFileName() + " isn't a VGM file";
+
+    uint32_t version = read32(d, VGM_VERSION_OFFSET);
+    // before 1.50 the commands always start at 0x40
+    size_t start = 0x40;
+    if (version >= 0x150 && read32(d, VGM_DATA_OFFSET) != 0) {
+        start = VGM_DATA_OFFSET + read32(d, VGM_DATA_OFFSET);
+    }
+    if (version < 0x161 || start < VGM_DMG_CLOCK_OFFSET + 4 || read32(d, VGM_DMG_CLOCK_OFFSET) == 0) {
+        return file.getFileName() + " has nothing for the Game Boy";
+    }
+    if (start >= size) return file.getFileName() + " is truncated";
+
+    song->data = d;
+    song->size = size;
+    song->start = start;
+    song->loop = 0;
+    song->totalSamples = read32(d, VGM_TOTAL_SAMPLES);
+    song->loopSamples = 0;
+    if (read32(d, VGM_LOOP_OFFSET) != 0) {
+        size_t loop = VGM_LOOP_OFFSET + read32(d, VGM_LOOP_OFFSET);
+        int64_t loopSamples = read32(d, VGM_LOOP_SAMPLES);
+        if (loop >= start && loop < size && loopSamples > 0 && loopSamples <= song->totalSamples) {
+            song->loop = loop;
+            song->loopSamples = loopSamples;
+        }
+    }
+    takeSnapshots(*song);
+
+    {
+        const juce::SpinLock::ScopedLockType lock(lock_);
+        std::swap(song_, song);
+        file_ = file;
+        changed_ = true;
+    }
+    // the old song, if any, is unmapped here rather than under the lock
+    return {};
+}
+
+void VgmPlayer::unload()
+{
+    std::unique_ptr<Song> song;
+    const juce::SpinLock::ScopedLockType lock(lock_);
+    std::swap(song_, song);
+    file_ = juce::File();
+}
+
+bool VgmPlayer::isLoaded()
+{
+    const juce::SpinLock::ScopedLockType lock(lock_);
+    return song_ != nullptr;
+}
+
+juce::File VgmPlayer::getFile()
+{
+    const juce::SpinLock::ScopedLockType lock(lock_);
+    return file_;
+}
+
+double VgmPlayer::getLengthSeconds()
+{
+    const juce::SpinLock::ScopedLockType lock(lock_);
+    if (song_ == nullptr) return 0.0;
+    return (double) song_->totalSamples / (double) VGM_SAMPLE_RATE;
+}
+
+void VgmPlayer::configure(double sampleRate, int channels, int samplesPerBlock)
+{
+    apu_.configure(sampleRate, channels, samplesPerBlock);
+    buffer_.setSize(channels, samplesPerBlock);
+    sampleRate_ = sampleRate;
+    maxBlockSize_ = samplesPerBlock;
+    // start over, since the sample rate may have changed
+    nextPosition_ = -1;
+}
+
+void VgmPlayer::render(juce::AudioBuffer<float>* out, int64_t position, bool playing)
+{
+    // the host stopped. If it starts again from the same place, the
+    // song continues from where it was
+    if (!playing) return;
+    jassert(maxBlockSize_ > 0); // configure() must be called first
+    // if the message thread is swapping the song, skip this block
+    const juce::SpinLock::ScopedTryLockType lock(lock_);
+    if (!lock.isLocked() || song_ == nullptr) return;
+    const Song& song = *song_;
+
+    int numSamples = out->getNumSamples();
+    for (int start = 0; start < numSamples; start += maxBlockSize_) {
+        int count = std::min(maxBlockSize_, numSamples - start);
+        if (changed_ || position + start != nextPosition_) {
+            changed_ = false;
+            seek(song, (int64_t) ((double) (position + start) * (double) VGM_SAMPLE_RATE / sampleRate_));
+        }
+        // writes are never scheduled past the end of the block, so
+        // the frame always ends on this block's last sample
+        play(song, apu_.frameStart() + apu_.clocksUntil(count));
+        apu_.readSamples(&buffer_, 0, count);
+        for (int c = 0; c < std::min(out->getNumChannels(), buffer_.getNumChannels()); c++) {
+            out->addFrom(c, start, buffer_, c, 0, count);
+        }
+        nextPosition_ = position + start + count;
+    }
+}
+
+int64_t VgmPlayer::clockAt(int64_t sample) const
+{
+    // to the nearest clock
+    int64_t samples = sample - originSample_;
+    return originClock_ + (samples * VGM_DMG_CLOCK + VGM_SAMPLE_RATE / 2) / VGM_SAMPLE_RATE;
+}
+
+// a snapshot per second of the song
+static const int64_t SNAPSHOT_INTERVAL = VGM_SAMPLE_RATE;
+
+// Read the song once without playing it, noting where it's up to every
+// SNAPSHOT_INTERVAL. Each snapshot is taken at the first command at or
+// after its time, which is where seeking from the start would stop too.
+void VgmPlayer::takeSnapshots(Song& song)
+{
+    Cursor cursor;
+    cursor.pos = song.start;
+    cursor.sample = 0;
+    cursor.finished = false;
+    cursor.loopedAt = -1;
+    std::memset(cursor.registers, 0, sizeof(cursor.registers));
+    song.snapshots.reserve((size_t) (song.totalSamples / SNAPSHOT_INTERVAL) + 1);
+    song.snapshots.push_back(cursor);
+    int64_t next = SNAPSHOT_INTERVAL;
+    // after the first loop the same places come around again
+    while (!cursor.finished && cursor.loopedAt < 0) {
+        if (cursor.sample >= next) {
+            song.snapshots.push_back(cursor);
+            next = cursor.sample + SNAPSHOT_INTERVAL;
+        }
+        step(song, cursor);
+    }
+}
+
+// Start playing from VGM sample target at the start of the current
+// frame. The registers at that point are found by going through the
+// song from the last snapshot before it without playing it, then
+// written all at once.
+void VgmPlayer::seek(const Song& song, int64_t target)
+{
+    // after the first time through, the song is in its loop
+    int64_t loopStart = song.totalSamples - song.loopSamples;
+    if (song.loop != 0 && target >= song.totalSamples) {
+        target = loopStart + (target - loopStart) % song.loopSamples;
+    }
+    auto snapshot = std::upper_bound(song.snapshots.begin(), song.snapshots.end(), target,
+                                     [](int64_t t, const Cursor& c) { return t < c.sample; });
+    // the first snapshot is the start of the song
+    if (snapshot != song.snapshots.begin()) --snapshot;
+    cursor_ = *snapshot;
+    while (!cursor_.finished && cursor_.sample < target) {
+        step(song, cursor_);
+    }
+    originSample_ = target;
+    originClock_ = apu_.frameStart();
+    forEachRegisterToRestore([&](gb_addr_t addr) {
+        apu_.writeRegisterAt(0, addr, cursor_.registers[addr - Gb_Apu::start_addr]);
+    });
+}
+
+// play the commands before endClock
+void VgmPlayer::play(const Song& song, int64_t endClock)
+{
+    while (!cursor_.finished && clockAt(cursor_.sample) < endClock) {
+        int64_t sample = cursor_.sample;
+        int reg = step(song, cursor_);
+        if (reg >= 0) {
+            apu_.writeRegisterAt((blip_time_t) (clockAt(sample) - apu_.frameStart()),
+                                 Gb_Apu::start_addr + reg, cursor_.registers[reg]);
+        }
+    }
+}
+
+// Run one command. Returns the register it wrote, or -1 if it wasn't a
+// write.
+int VgmPlayer::step(const Song& song, Cursor& cursor)
+{
+    const uint8_t* d = song.data + cursor.pos;
+    size_t remaining = song.size - cursor.pos;
+    if (remaining == 0) {
+        // the commands ran to the end of the file without an end command
+        cursor.finished = true;
+        return -1;
+    }
+    uint8_t command = d[0];
+    size_t size = commandSize(command);
+    if (command == VGM_DATA_BLOCK && remaining >= 7) {
+        size = 7 + read32(d, 3);
+    }
+    if (size == 0 || size > remaining) {
+        // unknown command or truncated file, there's no way to go on
+        cursor.finished = true;
+        return -1;
+    }
+    cursor.pos += size;
+
+    if (command == VGM_DMG_WRITE) {
+        // the high bit is for a second Game Boy, which isn't played
+        uint8_t reg = d[1];
+        if (reg >= Gb_Apu::register_count) return -1;
+        cursor.registers[reg] = d[2];
+        return reg;
+    } else if (command == VGM_WAIT) {
+        cursor.sample += d[1] | (d[2] << 8);
+    } else if (command == VGM_WAIT_60HZ) {
+        cursor.sample += 735;
+    } else if (command == VGM_WAIT_50HZ) {
+        cursor.sample += 882;
+    } else if (command >= VGM_WAIT_SHORT && command <= VGM_WAIT_SHORT + 0x0F) {
+        cursor.sample += command - VGM_WAIT_SHORT + 1;
+    } else if (command >= 0x80 && command <= 0x8F) {
+        // a YM2612 write followed by a wait
+        cursor.sample += command - 0x80;
+    } else if (command == VGM_END) {
+        // a loop which doesn't take any time would never end
+        if (song.loop == 0 || cursor.loopedAt == cursor.sample) {
+            cursor.finished = true;
+        } else {
+            cursor.loopedAt = cursor.sample;
+            cursor.pos = song.loop;
+        }
+    }
+    return -1;
+}
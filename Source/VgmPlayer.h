@@ -0,0 +1,101 @@
+/*
+  ==============================================================================
+
+    VgmPlayer.h
+    Created: 17 Oct 2026 5:02:48pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Synth.h"
+
+// Plays the Game Boy register writes of a .vgm file, such as the ones
+// VgmRecorder makes, through its own Apu at their exact clock times.
+// The file is memory mapped and read in place.
+// render() follows the host's position. When the position jumps, the
+// registers at the new position are found by reading the file from the
+// nearest of the snapshots load() takes every second, which is the only
+// time playing costs more than the writes.
+// load() and unload() are called from the message thread and render()
+// from the audio thread, which never blocks or allocates.
+class VgmPlayer
+{
+public:
+    VgmPlayer();
+
+    // Returns an error message, or an empty string on success
+    juce::String load(const juce::File& file);
+    void unload();
+    bool isLoaded();
+    juce::File getFile();
+    // length of the song, not counting any loops
+    double getLengthSeconds();
+
+    void configure(double sampleRate, int channels, int samplesPerBlock);
+    // call before rendering, or from the audio thread
+    void setQuality(SynthQuality quality) { apu_.setQuality(quality); }
+    // Add the song's samples from position, in samples at the
+    // configured rate since the start of the song. Nothing is played
+    // while the host isn't playing.
+    void render(juce::AudioBuffer<float>* out, int64_t position, bool playing);
+
+private:
+    // how far a song has been read
+    struct Cursor
+    {
+        size_t pos;
+        // time of the next command, in VGM samples
+        int64_t sample;
+        bool finished;
+        // sample when the song last looped
+        int64_t loopedAt;
+        // the registers the song has written
+        uint8_t registers[Gb_Apu::register_count];
+    };
+
+    struct Song
+    {
+        std::unique_ptr<juce::MemoryMappedFile> file;
+        const uint8_t* data;
+        size_t size;
+        // where the commands start, and where to go back to at the
+        // end, 0 if the song doesn't loop
+        size_t start;
+        size_t loop;
+        int64_t totalSamples;
+        int64_t loopSamples;
+        // where the song is up to at regular times in its first pass,
+        // in order, starting with the start of the song
+        std::vector<Cursor> snapshots;
+    };
+
+    // guards song_, file_ and changed_
+    juce::SpinLock lock_;
+    std::unique_ptr<Song> song_;
+    juce::File file_;
+    // the song was replaced, so render() must start over
+    bool changed_;
+
+    Apu apu_;
+    juce::AudioBuffer<float> buffer_;
+    double sampleRate_;
+    int maxBlockSize_;
+
+    // where the song is up to, only used by the audio thread
+    Cursor cursor_;
+    // the Apu's clock at VGM sample originSample_
+    int64_t originSample_;
+    int64_t originClock_;
+    // the host position the next block will start at if it's continuous
+    int64_t nextPosition_;
+
+    int64_t clockAt(int64_t sample) const;
+    void seek(const Song& song, int64_t sample);
+    void play(const Song& song, int64_t endClock);
+    static void takeSnapshots(Song& song);
+    static int step(const Song& song, Cursor& cursor);
+};
@@ -0,0 +1,99 @@
+/*
+  ==============================================================================
+
+    VgmPlayerTests.cpp
+    Created: 17 Oct 2026 9:26:05pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#include "Tests.h"
+#include "VgmPlayer.h"
+#include "Vgm.h"
+
+// VGM files whose commands run to the end of the file without an end
+// command, as a recorder that was cut off would leave them. They're
+// exactly a page long, so that reading past the end of the mapping
+// faults rather than finding zeros.
+static const size_t FIXTURE_SIZE = 4096;
+
+static void put32(std::vector<uint8_t>& data, size_t offset, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) data[offset + i] = (uint8_t) (value >> (8 * i));
+}
+
+// A square note held with 60Hz waits up to the end of the file. If
+// cutWrite, the last command is a register write missing its value.
+static std::vector<uint8_t> makeUnterminated(bool cutWrite)
+{
+    std::vector<uint8_t> data(VGM_HEADER_SIZE, 0);
+    std::memcpy(data.data(), "Vgm ", 4);
+    put32(data, VGM_VERSION_OFFSET, VGM_VERSION);
+    put32(data, VGM_DATA_OFFSET, VGM_HEADER_SIZE - VGM_DATA_OFFSET);
+    put32(data, VGM_DMG_CLOCK_OFFSET, VGM_DMG_CLOCK);
+    // power, full volume on both sides, then the note on square 1
+    const uint8_t writes[][2] = {
+        { 0x16, 0x80 }, { 0x14, 0x77 }, { 0x15, 0xFF },
+        { 0x01, 0x80 }, { 0x02, 0xF0 }, { 0x03, 0x00 }, { 0x04, 0x87 },
+    };
+    for (auto& w : writes) data.insert(data.end(), { VGM_DMG_WRITE, w[0], w[1] });
+    size_t waitsEnd = cutWrite ? FIXTURE_SIZE - 2 : FIXTURE_SIZE;
+    uint32_t samples = 0;
+    while (data.size() < waitsEnd) {
+        data.push_back(VGM_WAIT_60HZ);
+        samples += 735;
+    }
+    if (cutWrite) data.insert(data.end(), { VGM_DMG_WRITE, 0x02 });
+    put32(data, VGM_EOF_OFFSET, (uint32_t) data.size() - VGM_EOF_OFFSET);
+    put32(data, VGM_TOTAL_SAMPLES, samples);
+    jassert(data.size() == FIXTURE_SIZE);
+    return data;
+}
+
+// Load the file and play it through, past its end and seeking back into
+// it. It has to play the note and stop at the end of the file.
+static bool playUnterminated(const char* name, bool cutWrite)
+{
+    std::vector<uint8_t> data = makeUnterminated(cutWrite);
+    juce::TemporaryFile file(".vgm");
+    if (!file.getFile().replaceWithData(data.data(), data.size())) {
+        std::cerr << name << ": couldn't write the file" << std::endl;
+        return false;
+    }
+    VgmPlayer player;
+    const int blockSize = 512;
+    player.configure((double) VGM_SAMPLE_RATE, 2, blockSize);
+    juce::String error = player.load(file.getFile());
+    if (error.isNotEmpty()) {
+        std::cerr << name << ": " << error << std::endl;
+        return false;
+    }
+
+    juce::AudioBuffer<float> out(2, blockSize);
+    int64_t length = (int64_t) (player.getLengthSeconds() * VGM_SAMPLE_RATE);
+    float peak = 0.0f;
+    for (int64_t position = 0; position < length + VGM_SAMPLE_RATE; position += blockSize) {
+        out.clear();
+        player.render(&out, position, true);
+        if (position < length) peak = std::max(peak, out.getMagnitude(0, 0, blockSize));
+    }
+    // the last snapshot, and just before the end
+    out.clear();
+    player.render(&out, length - blockSize, true);
+    player.render(&out, length / 2, true);
+    if (peak == 0.0f) {
+        std::cerr << name << ": nothing was played" << std::endl;
+        return false;
+    }
+    std::cerr << name << ": ok" << std::endl;
+    return true;
+}
+
+bool runVgmPlayerTests()
+{
+    bool ok = true;
+    ok &= playUnterminated("VGM without an end command", false);
+    ok &= playUnterminated("VGM cut off in a write", true);
+    return ok;
+}
@@ -0,0 +1,162 @@
+/*
+  ==============================================================================
+
+    VgmRecorder.cpp
+    Created: 17 Oct 2026 4:21:37pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#include "VgmRecorder.h"
+#include "Vgm.h"
+
+VgmRecorder::VgmRecorder() :
+    juce::Thread("VGM recorder"),
+    fifo_(CAPACITY)
+{
+    session_ = 0;
+    lastSession_ = 0;
+    dropped_ = 0;
+    started_ = false;
+    startClock_ = 0;
+    samplesWritten_ = 0;
+}
+
+VgmRecorder::~VgmRecorder()
+{
+    stop();
+}
+
+bool VgmRecorder::start(const juce::File& file)
+{
+    stop();
+    auto out = std::make_unique<juce::FileOutputStream>(file);
+    if (!out->openedOk()) return false;
+    out->setPosition(0);
+    out->truncate();
+    // the sizes are filled in by finish()
+    out->write("Vgm ", 4);
+    out->writeInt(0); // end of file offset
+    out->writeInt(VGM_VERSION);
+    out->writeRepeatedByte(0, VGM_DATA_OFFSET - VGM_VERSION_OFFSET - 4);
+    out->writeInt(VGM_HEADER_SIZE - VGM_DATA_OFFSET);
+    out->writeRepeatedByte(0, VGM_DMG_CLOCK_OFFSET - VGM_DATA_OFFSET - 4);
+    out->writeInt(VGM_DMG_CLOCK);
+    out->writeRepeatedByte(0, VGM_HEADER_SIZE - VGM_DMG_CLOCK_OFFSET - 4);
+    if (out->getStatus().failed()) return false;
+    out_ = std::move(out);
+
+    // the ring is only allocated by the first recording, since most
+    // instances never record
+    if (ring_ == nullptr) ring_.allocate(CAPACITY, false);
+    started_ = false;
+    samplesWritten_ = 0;
+    dropped_ = 0;
+    // a new session, so that the Apu calls begin()
+    lastSession_ = lastSession_ % 0x7FFFFFFF + 1;
+    startThread();
+    session_.store(lastSession_, std::memory_order_release);
+    return true;
+}
+
+void VgmRecorder::stop()
+{
+    if (session_.load() == 0) return;
+    session_.store(0);
+    // the thread drains whatever is left before it exits
+    stopThread(-1);
+    finish();
+}
+
+void VgmRecorder::begin(int session, int64_t clock, const uint8_t* registers)
+{
+    // a write to address 0 marks the start of a session. The file
+    // thread drops anything before the one for the current session,
+    // which may be left over from an earlier one. The registers which
+    // follow it have the session's start clock.
+    write(session, 0, 0);
+    forEachRegisterToRestore([&](gb_addr_t addr) {
+        write(clock, addr, registers[addr - Gb_Apu::start_addr]);
+    });
+}
+
+void VgmRecorder::write(int64_t clock, gb_addr_t addr, uint8_t data)
+{
+    const auto scope = fifo_.write(1);
+    RecordedWrite* w;
+    if (scope.blockSize1 > 0) {
+        w = &ring_[scope.startIndex1];
+    } else if (scope.blockSize2 > 0) {
+        w = &ring_[scope.startIndex2];
+    } else {
+        dropped_++;
+        return;
+    }
+    w->clock = clock;
+    w->addr = addr;
+    w->data = data;
+}
+
+void VgmRecorder::run()
+{
+    while (!threadShouldExit()) {
+        drain();
+        wait(10);
+    }
+    drain();
+}
+
+void VgmRecorder::drain()
+{
+    int ready = fifo_.getNumReady();
+    if (ready == 0) return;
+    const auto scope = fifo_.read(ready);
+    for (int block = 0; block < 2; block++) {
+        int start = block == 0 ? scope.startIndex1 : scope.startIndex2;
+        int size = block == 0 ? scope.blockSize1 : scope.blockSize2;
+        for (int i = start; i < start + size; i++) {
+            const RecordedWrite& w = ring_[i];
+            if (w.addr == 0) {
+                if (w.clock == lastSession_) {
+                    started_ = true;
+                    startClock_ = -1;
+                }
+                continue;
+            }
+            if (!started_) continue;
+            if (startClock_ < 0) startClock_ = w.clock;
+            // to the nearest sample
+            int64_t sample = ((w.clock - startClock_) * VGM_SAMPLE_RATE + VGM_DMG_CLOCK / 2) / VGM_DMG_CLOCK;
+            writeWait(sample - samplesWritten_);
+            uint8_t command[3] = { VGM_DMG_WRITE, (uint8_t) (w.addr - Gb_Apu::start_addr), w.data };
+            out_->write(command, 3);
+        }
+    }
+}
+
+void VgmRecorder::writeWait(int64_t samples)
+{
+    if (samples <= 0) return;
+    samplesWritten_ += samples;
+    while (samples > 16) {
+        int n = (int) std::min(samples, (int64_t) 0xFFFF);
+        uint8_t command[3] = { VGM_WAIT, (uint8_t) (n & 0xFF), (uint8_t) (n >> 8) };
+        out_->write(command, 3);
+        samples -= n;
+    }
+    if (samples > 0) out_->writeByte((char) (VGM_WAIT_SHORT + samples - 1));
+}
+
+void VgmRecorder::finish()
+{
+    out_->writeByte((char) VGM_END);
+    int64_t size = out_->getPosition();
+    // the end of file offset and total length in the header
+    out_->setPosition(VGM_EOF_OFFSET);
+    out_->writeInt((int) (size - VGM_EOF_OFFSET));
+    out_->setPosition(VGM_TOTAL_SAMPLES);
+    out_->writeInt((int) samplesWritten_);
+    out_->flush();
+    out_.reset();
+}
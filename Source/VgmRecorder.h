@@ -0,0 +1,77 @@
+/*
+  ==============================================================================
+
+    VgmRecorder.h
+    Created: 17 Oct 2026 4:21:37pm
+    Author:  Charles Julian Knight
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Gb_Snd_Emu-0.1.4-patched/gb_apu/Gb_Apu.h"
+
+// A register write with its time in clocks since the APU started. A
+// write to address 0 marks the start of a recording session instead,
+// with the session number in place of the clock.
+struct RecordedWrite
+{
+    int64_t clock;
+    gb_addr_t addr;
+    uint8_t data;
+};
+
+// Captures the register writes of one Apu into a .vgm file, which
+// hardware players and other emulators can play back.
+// The Apu pushes its writes into a preallocated lock-free ring from
+// the audio thread, and a background thread drains the ring into the
+// file. Neither side blocks or allocates while recording.
+// start() and stop() must be called from the same (non-audio) thread.
+class VgmRecorder : private juce::Thread
+{
+public:
+    // about a second of heavy automation, the file thread catches up
+    // long before the ring is full
+    static const int CAPACITY = 16384;
+
+    VgmRecorder();
+    ~VgmRecorder() override;
+
+    // Returns false if the file couldn't be written
+    bool start(const juce::File& file);
+    // finish the file, which is complete once this returns
+    void stop();
+    bool isRecording() const { return session_.load() != 0; }
+    // writes which didn't fit in the ring and so are missing from the
+    // last recording
+    int droppedWrites() const { return dropped_.load(); }
+
+    // The Apu side. Recording sessions are numbered, 0 meaning not
+    // recording; when a new one starts, the Apu calls begin() with
+    // its current registers before sending any writes.
+    int session() const { return session_.load(std::memory_order_acquire); }
+    void begin(int session, int64_t clock, const uint8_t* registers);
+    void write(int64_t clock, gb_addr_t addr, uint8_t data);
+
+private:
+    juce::AbstractFifo fifo_;
+    juce::HeapBlock<RecordedWrite> ring_;
+    std::atomic<int> session_;
+    // the current (or last) session, only changed while the file
+    // thread isn't running
+    int lastSession_;
+    std::atomic<int> dropped_;
+
+    // only used by the file thread while it's running
+    std::unique_ptr<juce::FileOutputStream> out_;
+    bool started_;
+    int64_t startClock_;
+    int64_t samplesWritten_;
+
+    void run() override;
+    void drain();
+    void writeWait(int64_t samples);
+    void finish();
+};
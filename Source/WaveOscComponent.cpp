@@ -13,7 +13,7 @@
 #include "Theme.h"
 
 //==============================================================================
-WaveOscComponent::WaveOscComponent() : controls(2), shapePicker("Shape")
+WaveOscComponent::WaveOscComponent(Synth& synth) : wavetable(synth), controls(synth, 2), shapePicker("Shape")
 {
     addAndMakeVisible(controls);
 
@@ -23,7 +23,11 @@ WaveOscComponent::WaveOscComponent() : controls(2), shapePicker("Shape")
     shapePicker.addItem("saw", 4);
     shapePicker.addItem("noise", 5);
     shapePicker.addListener(this);
-    shapePicker.setSelectedId(2);
+    // show which shape the synth's wavetable is, if any
+    const uint8_t* shapes[] = { WAVE_TABLE_SQUARE, WAVE_TABLE_SINE, WAVE_TABLE_TRIANGLE, WAVE_TABLE_SAW, WAVE_TABLE_NOISE };
+    for (int i = 0; i < 5; i++) {
+        if (wavetable.matches(shapes[i])) shapePicker.setSelectedId(i + 1, juce::dontSendNotification);
+    }
     shapePicker.setTextWhenNothingSelected("custom");
     addAndMakeVisible(shapePicker);
 
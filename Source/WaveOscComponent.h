@@ -22,7 +22,7 @@ class WaveOscComponent  : public juce::Component,
                             public juce::ChangeListener
 {
 public:
-    WaveOscComponent();
+    WaveOscComponent(Synth& synth);
     ~WaveOscComponent() override;
 
     WavetableComponent wavetable;
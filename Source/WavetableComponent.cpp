@@ -17,7 +17,10 @@
 static int widthUnits = WAVE_TABLE_SIZE;
 static int heightUnits = 16;
 
-WavetableComponent::WavetableComponent() {}
+WavetableComponent::WavetableComponent(Synth& synth) : synth_(synth)
+{
+    std::memcpy(wavetable, synth.getParameters().wavetable, WAVE_TABLE_SIZE);
+}
 
 WavetableComponent::~WavetableComponent() {}
 
@@ -103,9 +106,14 @@ void WavetableComponent::loadDefaultWavetable(const uint8_t* defaultWavetable)
     wavetableChanged();
 }
 
+bool WavetableComponent::matches(const uint8_t* otherWavetable)
+{
+    return std::memcmp(wavetable, otherWavetable, WAVE_TABLE_SIZE) == 0;
+}
+
 void WavetableComponent::wavetableChanged()
 {
     repaint(drawingBounds());
-    Synth::INSTANCE.setWaveTable(wavetable);
+    synth_.setWaveTable(wavetable);
     changed_ = false;
 }
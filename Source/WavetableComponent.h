@@ -20,19 +20,21 @@ class WavetableComponent  : public juce::Component,
                             public juce::ChangeBroadcaster
 {
 public:
-    WavetableComponent();
+    WavetableComponent(Synth& synth);
     ~WavetableComponent() override;
 
     void paint (juce::Graphics&) override;
     void resized() override;
 
     void loadDefaultWavetable(const uint8_t* defaultWavetable);
+    bool matches(const uint8_t* otherWavetable);
 
     void mouseDown(const juce::MouseEvent& event) override;
     void mouseDrag(const juce::MouseEvent& event) override;
     void mouseUp(const juce::MouseEvent& event) override;
 
 private:
+    Synth& synth_;
     bool changed_ = false;
     uint8_t wavetable[WAVE_TABLE_SIZE];
 
@@ -5,11 +5,7 @@
 
 #include "./types.h"
 #include "./staticlinkedlist.h"
-
-struct MidiEvent {
-  uint8_t note;
-  uint8_t velocity;
-};
+#include "./policies.h"
 
 // A MidiManager tracks the state of pressed keys through
 // MIDI messages, and assigns keys to a given number of voices.
@@ -24,16 +20,78 @@ struct MidiEvent {
 // then the oldest pressed keys will be forgotten.
 // The default number of voices is VSize but this can actually
 // be reduced at runtime.
-// Voices are assigned least-recently-used first.
+// Which voice a new key gets, whether it can steal one, and
+// which waiting key gets a released voice is decided by Policy
+// (see policies.h). By default voices are assigned
+// least-recently-used first.
+// Every tracked note is indexed by note number, so handling
+// a message is constant time regardless of VSize and MSize
+// (although some policies search the index).
+
+template <size_t MSize, size_t VSize, typename Policy = LruPolicy>
+class MidiManager {
+  friend Policy;
+  // so that policies can derive from the built-in ones
+  friend LruPolicy;
+  friend NoStealPolicy;
+  friend LowestNotePolicy;
+  friend HighestNotePolicy;
+  friend RoundRobinPolicy;
 
-template <size_t MSize, size_t VSize> class MidiManager {
  private:
   typedef size_t Voice;
   MidiEvent voices_[VSize];
   size_t supportedVoices_;
+  Policy policy_;
   StaticLinkedList<Voice, VSize> unassigned_voices_;
   StaticLinkedList<Voice, VSize> assigned_voices_;
   StaticLinkedList<MidiEvent, MSize> pending_notes_;
+  // where each note is in assigned_voices_ or pending_notes_,
+  // or nullptr if it's not in that list
+  Node<Voice>* assigned_index_[128];
+  Node<MidiEvent>* pending_index_[128];
+  // where each voice is in unassigned_voices_, or nullptr
+  Node<Voice>* unassigned_index_[VSize];
+
+  void assign(Voice v, MidiEvent e) {
+    voices_[v] = e;
+    assigned_index_[e.note] = assigned_voices_.pushQueue(v);
+  }
+
+  void unassign(Voice v) {
+    assigned_voices_.remove(assigned_index_[voices_[v].note]);
+    assigned_index_[voices_[v].note] = nullptr;
+  }
+
+  void release(Voice v) {
+    voices_[v].velocity = 0;
+    unassigned_index_[v] = unassigned_voices_.pushQueue(v);
+  }
+
+  // take the voice the policy picks out of unassigned_voices_
+  Voice takeFree() {
+    Voice v = policy_.freeVoice(*this);
+    unassigned_voices_.remove(unassigned_index_[v]);
+    unassigned_index_[v] = nullptr;
+    return v;
+  }
+
+  // take the note the policy picks out of pending_notes_
+  MidiEvent takePending() {
+    Node<MidiEvent>* pending = pending_index_[policy_.nextPending(*this)];
+    MidiEvent e = pending->data;
+    pending_notes_.remove(pending);
+    pending_index_[e.note] = nullptr;
+    return e;
+  }
+
+  void pushPending(MidiEvent e) {
+    if (pending_notes_.isFull()) {
+      // the oldest pending note is about to be forgotten
+      pending_index_[pending_notes_.bottom().note] = nullptr;
+    }
+    pending_index_[e.note] = pending_notes_.pushStack(e);
+  }
 
  public:
   MidiManager() {
@@ -45,70 +103,53 @@ template <size_t MSize, size_t VSize> class MidiManager {
     MidiEvent e;
     e.note = note & 0x7F;
     e.velocity = velocity & 0x7F;
+    Node<Voice>* assigned = assigned_index_[e.note];
+    Node<MidiEvent>* pending = pending_index_[e.note];
     if (e.velocity > 0) {
       // update the velocity if it's already playing
-      Iterator<Voice> i = assigned_voices_.iterator();
-      while (i.hasNext()) {
-        Voice& v = i.next();
-        if (voices_[v].note == e.note) {
-          voices_[v].velocity = e.velocity;
-          return;
-        }
+      if (assigned != nullptr) {
+        voices_[assigned->data].velocity = e.velocity;
+        return;
       }
       // update the velocity if it's already tracked
-      Iterator<MidiEvent> ni = pending_notes_.iterator();
-      while (ni.hasNext()) {
-        MidiEvent& n = ni.next();
-        if (n.note == e.note) {
-          n.velocity = e.velocity;
-          return;
-        }
+      if (pending != nullptr) {
+        pending->data.velocity = e.velocity;
+        return;
       }
       // must be a new note
       Voice v;
-      if (unassigned_voices_.isEmpty()) {
-        v = assigned_voices_.pop();  // steal oldest voice
+      if (!unassigned_voices_.isEmpty()) {
+        v = takeFree();
+      } else if (policy_.stealVoice(*this, e, &v)) {
+        unassign(v);
         // save that voice's current note for later
-        pending_notes_.pushStack(voices_[v]);
+        pushPending(voices_[v]);
       } else {
-        v = unassigned_voices_.pop();
+        // wait for a voice to be released
+        pushPending(e);
+        return;
       }
-      assigned_voices_.pushQueue(v);
-      voices_[v] = e;
+      assign(v, e);
       return;
     }
     // else note off
 
     // if it's a queued note simply forget about it
-    Iterator<MidiEvent> ni = pending_notes_.iterator();
-    size_t i = 0;
-    while (ni.hasNext()) {
-      MidiEvent& n = ni.next();
-      if (n.note == e.note) {
-        n.velocity = 0;
-        pending_notes_.removeAt(i);
-        return;
-      }
-      i++;
+    if (pending != nullptr) {
+      pending->data.velocity = 0;
+      pending_notes_.remove(pending);
+      pending_index_[e.note] = nullptr;
+      return;
     }
 
-    Iterator<Voice> vi = assigned_voices_.iterator();
-    i = 0;
-    while (vi.hasNext()) {
-      Voice v = vi.next();
-      if (voices_[v].note != e.note) {
-        i++;
-        continue;
-      }
+    if (assigned != nullptr) {
+      Voice v = assigned->data;
       // pressed note is now off
-      assigned_voices_.removeAt(i);
+      unassign(v);
       if (pending_notes_.isEmpty()) {
-        voices_[v].velocity = 0;
-        unassigned_voices_.pushQueue(v);
+        release(v);
       } else {
-        MidiEvent pending = pending_notes_.pop();
-        voices_[v] = pending;
-        assigned_voices_.pushQueue(v);
+        assign(v, takePending());
       }
       return;
     }
@@ -121,21 +162,49 @@ template <size_t MSize, size_t VSize> class MidiManager {
     pending_notes_.clear();
     assigned_voices_.clear();
     unassigned_voices_.clear();
+    for (size_t n = 0; n < 128; n++) {
+      assigned_index_[n] = nullptr;
+      pending_index_[n] = nullptr;
+    }
+    for (Voice v = 0; v < VSize; v++) {
+      unassigned_index_[v] = nullptr;
+    }
     for (Voice v = 0; v < supportedVoices_; v++) {
-      voices_[v].velocity = 0;
       voices_[v].note = 0;
-      unassigned_voices_.pushQueue(v);
+      release(v);
     }
+    policy_.reset(supportedVoices_);
   }
 
-  // reduce the number of supported voices at runtime. This
-  // will reset the manager.
+  // change the number of supported voices at runtime. Held
+  // keys are kept: the keys playing on voices which are removed
+  // start waiting, and voices which are added are given to
+  // waiting keys.
   void setVoices(size_t voices) {
-    if (voices >= VSize || supportedVoices_ == voices) {
+    if (voices > VSize || supportedVoices_ == voices) {
       return;
     }
+    for (Voice v = voices; v < supportedVoices_; v++) {
+      if (unassigned_index_[v] != nullptr) {
+        unassigned_voices_.remove(unassigned_index_[v]);
+        unassigned_index_[v] = nullptr;
+      } else {
+        unassign(v);
+        pushPending(voices_[v]);
+      }
+      voices_[v].note = 0;
+      voices_[v].velocity = 0;
+    }
+    for (Voice v = supportedVoices_; v < voices; v++) {
+      voices_[v].note = 0;
+      release(v);
+    }
     supportedVoices_ = voices;
-    reset();
+    policy_.reset(voices);
+    while (!pending_notes_.isEmpty() && !unassigned_voices_.isEmpty()) {
+      Voice v = takeFree();
+      assign(v, takePending());
+    }
   }
 
   size_t voices() {
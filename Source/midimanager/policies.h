@@ -0,0 +1,132 @@
+// Copyright 2021 Charles Julian Knight
+// https://github.com/rabidaudio/midi-voicesteal
+#ifndef LIB_MIDIMANAGER_POLICIES_H_
+#define LIB_MIDIMANAGER_POLICIES_H_
+
+#include "./types.h"
+
+// Voice allocation policies for MidiManager. A policy is a
+// template parameter rather than a virtual interface, so the
+// choice is resolved at compile time. It is a friend of the
+// manager, and answers three questions:
+//  - freeVoice: which unassigned voice a new key gets (there
+//    is at least one).
+//  - stealVoice: which assigned voice a new key takes when
+//    there are none free. The key that was playing on it will
+//    wait until a voice is released. Return false to make the
+//    new key wait instead.
+//  - nextPending: which waiting key gets a released voice
+//    (there is at least one).
+// reset is called whenever the manager is reset or resized.
+// Policies may derive from the built-in ones to reuse their
+// answers.
+
+// Voices are assigned least-recently-used first, a new key
+// steals the voice which has been playing the longest, and a
+// released voice goes to the most-recently-pressed waiting key.
+struct LruPolicy {
+  void reset(size_t /*voices*/) {}
+
+  template <typename M>
+  typename M::Voice freeVoice(M& m) {
+    return m.unassigned_voices_.peek();
+  }
+
+  template <typename M>
+  bool stealVoice(M& m, MidiEvent /*e*/, typename M::Voice* v) {
+    *v = m.assigned_voices_.peek();
+    return true;
+  }
+
+  template <typename M>
+  uint8_t nextPending(M& m) {
+    return m.pending_notes_.peek().note;
+  }
+};
+
+// Like LruPolicy, but keys never steal a voice. Keys pressed
+// while every voice is in use wait for one to be released.
+struct NoStealPolicy : public LruPolicy {
+  template <typename M>
+  bool stealVoice(M& /*m*/, MidiEvent /*e*/, typename M::Voice* /*v*/) {
+    return false;
+  }
+};
+
+// The lowest keys held always sound: a new key only steals
+// the voice playing the highest key, and only if it's lower.
+// A released voice goes to the lowest waiting key.
+struct LowestNotePolicy : public LruPolicy {
+  template <typename M>
+  bool stealVoice(M& m, MidiEvent e, typename M::Voice* v) {
+    for (int n = 127; n > e.note; n--) {
+      if (m.assigned_index_[n] != nullptr) {
+        *v = m.assigned_index_[n]->data;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  template <typename M>
+  uint8_t nextPending(M& m) {
+    uint8_t n = 0;
+    while (m.pending_index_[n] == nullptr) n++;
+    return n;
+  }
+};
+
+// The highest keys held always sound: a new key only steals
+// the voice playing the lowest key, and only if it's higher.
+// A released voice goes to the highest waiting key.
+struct HighestNotePolicy : public LruPolicy {
+  template <typename M>
+  bool stealVoice(M& m, MidiEvent e, typename M::Voice* v) {
+    for (int n = 0; n < e.note; n++) {
+      if (m.assigned_index_[n] != nullptr) {
+        *v = m.assigned_index_[n]->data;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  template <typename M>
+  uint8_t nextPending(M& m) {
+    uint8_t n = 127;
+    while (m.pending_index_[n] == nullptr) n--;
+    return n;
+  }
+};
+
+// Voices are used in turn, in order of their index, skipping
+// any which are still playing. When none are free the next
+// voice in turn is stolen.
+struct RoundRobinPolicy : public LruPolicy {
+  size_t next_;
+  size_t voices_;
+
+  void reset(size_t voices) {
+    next_ = 0;
+    voices_ = voices;
+  }
+
+  template <typename M>
+  typename M::Voice freeVoice(M& m) {
+    typename M::Voice v = next_;
+    while (m.unassigned_index_[v] == nullptr) {
+      v = (v + 1) % voices_;
+    }
+    next_ = (v + 1) % voices_;
+    return v;
+  }
+
+  template <typename M>
+  bool stealVoice(M& /*m*/, MidiEvent /*e*/, typename M::Voice* v) {
+    *v = next_;
+    next_ = (next_ + 1) % voices_;
+    return true;
+  }
+};
+
+#endif  // LIB_MIDIMANAGER_POLICIES_H_
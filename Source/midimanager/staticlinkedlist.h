@@ -49,7 +49,10 @@ class Iterator {
 // as a stack or as a queue (or a combination).
 // It also has the ability to remove elements from arbitrary
 // positions in the list. All operations are constant time
-// except for arbitrary access and removal, which are linear.
+// except for access and removal by index, which are linear.
+// The push methods return the node holding the new item, which
+// stays valid until that item is popped, removed or forgotten,
+// and can be used to remove it again in constant time.
 // This class is *not* thread-safe.
 // TSize must be positive.
 template <typename T, size_t TSize> class StaticLinkedList {
@@ -122,18 +125,18 @@ template <typename T, size_t TSize> class StaticLinkedList {
   // pushStack adds an item to the top, i.e. the next item to be popped.
   // Use this if you wish to use the list as a stack. If the stack is full,
   // it will forget the oldest item in the stack. O(1).
-  void pushStack(const T item) {
+  Node<T>* pushStack(const T item) {
     if (cur_ == nullptr) {
       tail_->data = item;
       cur_ = tail_;
       size_ = 1;
       SLL_ASSERT_SANITY_CHECKS();
-      return;
+      return cur_;
     }
     if (TSize == 1) {
       cur_->data = item;
       SLL_ASSERT_SANITY_CHECKS();
-      return;
+      return cur_;
     }
     if (cur_->up == nullptr) {
       // we're full, so steal from the bottom
@@ -145,16 +148,15 @@ template <typename T, size_t TSize> class StaticLinkedList {
     cur_->data = item;
     size_++;
     SLL_ASSERT_SANITY_CHECKS();
-    return;
+    return cur_;
   }
 
   // pushQueue adds the item to the bottom, i.e. the last
   // item to be popped. Use this if you which to use the list
   // as a queue. Steals from the top if the list is full. O(1).
-  void pushQueue(const T item) {
+  Node<T>* pushQueue(const T item) {
     if (isEmpty() || TSize == 1) {
-      pushStack(item);
-      return;
+      return pushStack(item);
     }
     if (cur_ == head_) {
       size_--;
@@ -164,7 +166,7 @@ template <typename T, size_t TSize> class StaticLinkedList {
     tail_->data = item;
     size_++;
     SLL_ASSERT_SANITY_CHECKS();
-    return;
+    return tail_;
   }
 
   // look at the next item without chaning the list.
@@ -172,6 +174,17 @@ template <typename T, size_t TSize> class StaticLinkedList {
     return cur_->data;
   }
 
+  // look at the last item, i.e. the one pushStack will forget
+  // if the list is full.
+  T& bottom() {
+    return tail_->data;
+  }
+
+  bool isFull() {
+    SLL_ASSERT_SANITY_CHECKS();
+    return size_ == TSize;
+  }
+
   T& pop() {
     T* result = &cur_->data;
     // this will set cur_ to nullptr if we're at tail, which is expected
@@ -197,6 +210,17 @@ template <typename T, size_t TSize> class StaticLinkedList {
     size_--;
   }
 
+  // remove removes the item held by a node returned from one of
+  // the push methods. O(1)
+  void remove(Node<T>* item) {
+    if (item == cur_) {
+      pop();
+      return;
+    }
+    freeToHead(item);
+    size_--;
+  }
+
  private:
   void freeToTail(Node<T>* item) {
     if (item->up == nullptr) {
@@ -10,4 +10,9 @@
 #include <stdint.h>
 #endif  // ARDUINO
 
+struct MidiEvent {
+  uint8_t note;
+  uint8_t velocity;
+};
+
 #endif  // LIB_MIDIMANAGER_TYPES_H_